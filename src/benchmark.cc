@@ -30,6 +30,7 @@
 #include "search_thread.h"
 #include "transposition.h"
 #include "net_evaluation.h"
+#include "perft.h"
 #include "general/parse.h"
 #include "general/settings.h"
 #include "general/types.h"
@@ -41,6 +42,7 @@
 #include <iostream>
 #include <cmath>
 #include <chrono>
+#include <thread>
 
 namespace {
 
@@ -111,7 +113,7 @@ double MoveOrderTest() {
     game.set_to_position_after(0);
     while (game.board.get_num_made_moves() < game.moves.size() - 1) {
       int move_num = game.board.get_num_made_moves();
-      std::vector<Move> moves = search::GetSortedMovesML(game.board);
+      MoveList moves = search::GetSortedMovesML(game.board);
       if (moves.size() < 10) {
         game.forward();
         continue;
@@ -190,13 +192,17 @@ void PerftSuite() {
   while(std::getline(file, line)) {
     test_sets.emplace_back(line);
   }
+  const size_t num_threads = std::max(1u, std::thread::hardware_concurrency());
+  perft::Table table(perft::kPerftHashMB);
   Time start = now();
   size_t test_sets_passed = 0;
   for (size_t i = 0; i < test_sets.size(); i++) {
     PerftTestSet test_set = test_sets[i];
     bool passed = true;
     for (std::pair<Depth, size_t> depth_result : test_set.depth_results) {
-      if (search::Perft(test_set.board, depth_result.first) != depth_result.second) {
+      table.clear();
+      if (perft::ParallelPerft(test_set.board, depth_result.first, num_threads,
+                               table, false) != depth_result.second) {
         std::cout << "\033[31mFailed set " << i << " on input ("
             << depth_result.first << "," << depth_result.second << ")\033[0m"<< std::endl;
         passed = false;
@@ -471,9 +477,15 @@ void RunBenchCommand(int argc, char **argv) {
   int num_threads  = argc > 3 ? atoi(argv[3]) :  1;
   int megabytes = argc > 4 ? atoi(argv[4]) : 16;
 
+  search::Threads.set_num_threads(num_threads);
+  Time table_start = now();
   table::SetTableSize(megabytes);
+  Time table_resized = now();
+  table::ClearTable();
+  printf("Hash %d MB: resized in %d ms, cleared in %d ms\n", megabytes,
+         (int)std::chrono::duration_cast<Milliseconds>(table_resized - table_start).count(),
+         (int)std::chrono::duration_cast<Milliseconds>(now() - table_resized).count());
   Time initial_time = now();
-  search::Threads.set_num_threads(num_threads);
 
   for (int i = 0; i < kBenchmarkCommandPositions.size(); i++) {
 
@@ -116,6 +116,70 @@ inline HashType get_color_hash() {
 
 }
 
+HashType Board::GetZobristFingerprint() {
+  HashType fingerprint = hash::get_color_hash();
+  for (Color color = kWhite; color <= kBlack; ++color) {
+    for (PieceType piece_type = kPawn; piece_type <= kKing; ++piece_type) {
+      for (Square square = 0; square < 64; ++square) {
+        fingerprint = (fingerprint ^ hash::get_hash(color, piece_type, square)) * 0x9E3779B97F4A7C15ULL;
+        fingerprint ^= fingerprint >> 29;
+      }
+    }
+  }
+  return fingerprint;
+}
+
+namespace {
+
+//Cuckoo tables holding every reversible piece move, keyed by the hash difference
+//the move causes. A match against the difference to an earlier position means a
+//single move can repeat it. See Marcel van Kervinck, "Efficient detection of
+//upcoming repetitions".
+constexpr size_t kCuckooSize = 8192;
+
+inline size_t cuckoo_h1(const HashType key) { return key & (kCuckooSize - 1); }
+inline size_t cuckoo_h2(const HashType key) { return (key >> 16) & (kCuckooSize - 1); }
+
+struct CuckooTable {
+  CuckooTable();
+  std::array<HashType, kCuckooSize> keys;
+  std::array<Move, kCuckooSize> moves;
+};
+
+CuckooTable::CuckooTable() {
+  keys.fill(0);
+  moves.fill(kNullMove);
+  for (Color color = kWhite; color <= kBlack; ++color) {
+    for (PieceType piece_type = kKnight; piece_type <= kKing; ++piece_type) {
+      for (Square source = 0; source < 64; ++source) {
+        BitBoard destinations = piece_type == kKing ? magic::GetAttackMap<kKing>(source, 0)
+                                                    : magic::GetAttackMap(piece_type, source, 0);
+        //Both directions of a move share a key, so only one is stored.
+        destinations &= ~((GetSquareBitBoard(source) << 1) - 1);
+        for (; destinations; bitops::PopLSB(destinations)) {
+          const Square destination = bitops::NumberOfTrailingZeros(destinations);
+          Move move = GetMove(source, destination, kNormalMove);
+          HashType key = hash::get_hash(color, piece_type, source)
+              ^ hash::get_hash(color, piece_type, destination) ^ hash::get_color_hash();
+          size_t idx = cuckoo_h1(key);
+          while (true) {
+            std::swap(keys[idx], key);
+            std::swap(moves[idx], move);
+            if (move == kNullMove) {
+              break;
+            }
+            idx = idx == cuckoo_h1(key) ? cuckoo_h2(key) : cuckoo_h1(key);
+          }
+        }
+      }
+    }
+  }
+}
+
+const CuckooTable cuckoo;
+
+}
+
 namespace {
 
 enum class MoveGenType {
@@ -177,34 +241,19 @@ constexpr std::array<BitBoard, 4> castling_empty_bbs = {
 constexpr BitBoard all_castling_squares = castling_relevant_bbs[0] | castling_relevant_bbs[1]
                                         | castling_relevant_bbs[2] | castling_relevant_bbs[3];
 
-//Define helper functions for move history information
-void SaveEnPassant(MoveHistoryInformation &info, Square ep) {
-  info |= (ep << 4);
-}
-Square GetEnPassant(const MoveHistoryInformation info) {
-  return (info >> 4) & 0x3F;
-}
-void SaveMovingPiece(MoveHistoryInformation &info, Piece piece) {
-  info |= piece;
-}
-Piece GetMovingPiece(const MoveHistoryInformation info) {
-  return info & 0xF;
-}
-void SaveCastlingRights(MoveHistoryInformation &info, CastlingRights rights) {
-  info |= rights << 10;
-}
-CastlingRights GetCastlingRights(const MoveHistoryInformation info) {
-  return (info >> 10) & 0xF;
-}
-void SaveFiftyMoveCount(MoveHistoryInformation &info, int32_t count) {
-  info |= count << 14;
-}
-int32_t GetFiftyMoveCount(const MoveHistoryInformation info) {
-  return (info >> 14) & 0x7F;
+template<magic::SliderIndexing indexing>
+inline BitBoard GetPieceAttacks(const Piece piece, const Square square, const BitBoard all_pieces) {
+  const BitBoard square_bb = GetSquareBitBoard(square);
+  switch (GetPieceType(piece)) {
+  case kPawn: return GetPieceColor(piece) == kWhite ? bitops::NE(square_bb) | bitops::NW(square_bb)
+                                                    : bitops::SE(square_bb) | bitops::SW(square_bb);
+  case kKing: return magic::GetAttackMap<kKing, indexing>(square, all_pieces);
+  default: return magic::GetAttackMap<indexing>(GetPieceType(piece), square, all_pieces);
+  }
 }
 
 template<int Quiescent>
-void AddMoves(std::vector<Move> &move_list, Square source_square, BitBoard destinations,
+void AddMoves(MoveList &move_list, Square source_square, BitBoard destinations,
               BitBoard enemy_pieces) {
   for (BitBoard captures = destinations & enemy_pieces; captures; bitops::PopLSB(captures)) {
     Square destination_square = bitops::NumberOfTrailingZeros(captures);
@@ -218,8 +267,8 @@ void AddMoves(std::vector<Move> &move_list, Square source_square, BitBoard desti
   }
 }
 
-template<int Quiescent, MoveGenType move_gen_type, int PieceType>
-void AddMoves(std::vector<Move> &moves, std::vector<Move> &legal_moves, BitBoard piece_bitboard,
+template<int Quiescent, MoveGenType move_gen_type, int PieceType, magic::SliderIndexing indexing>
+void AddMoves(MoveList &moves, MoveList &legal_moves, BitBoard piece_bitboard,
               const BitBoard own_pieces, const BitBoard enemy_pieces,
               const BitBoard all_pieces, const BitBoard critical) {
   if (move_gen_type == MoveGenType::Normal) {
@@ -227,14 +276,14 @@ void AddMoves(std::vector<Move> &moves, std::vector<Move> &legal_moves, BitBoard
     piece_bitboard ^= not_pinned;
     for (; not_pinned; bitops::PopLSB(not_pinned)) {
       Square piece_square = bitops::NumberOfTrailingZeros(not_pinned);
-      BitBoard destinations = magic::GetAttackMap<PieceType>(piece_square, all_pieces);
+      BitBoard destinations = magic::GetAttackMap<PieceType, indexing>(piece_square, all_pieces);
       destinations &= ~own_pieces;
       AddMoves<Quiescent>(legal_moves, piece_square, destinations, enemy_pieces);
     }
   }
   for (; piece_bitboard; bitops::PopLSB(piece_bitboard)) {
     Square piece_square = bitops::NumberOfTrailingZeros(piece_bitboard);
-    BitBoard destinations = magic::GetAttackMap<PieceType>(piece_square, all_pieces);
+    BitBoard destinations = magic::GetAttackMap<PieceType, indexing>(piece_square, all_pieces);
     if (move_gen_type == MoveGenType::InCheck) {
       destinations &= critical;
     }
@@ -244,7 +293,7 @@ void AddMoves(std::vector<Move> &moves, std::vector<Move> &legal_moves, BitBoard
 }
 
 template<int Quiescent>
-inline void AddPromotionMoves(const Square src, const Square des, std::vector<Move> &moves) {
+inline void AddPromotionMoves(const Square src, const Square des, MoveList &moves) {
   moves.emplace_back(GetMove(src, des, kQueenPromotion));
   moves.emplace_back(GetMove(src, des, kKnightPromotion));
   if (Quiescent == kNonQuiescent) {
@@ -255,10 +304,10 @@ inline void AddPromotionMoves(const Square src, const Square des, std::vector<Mo
 
 template<int Quiescent, MoveGenType move_gen_type, Color point_of_view>
 inline void ConditionalAddPromotionMoves(const Square src, const Square des,
-                                         std::vector<Move> &moves,
+                                         MoveList &moves,
                                          const MoveType move_type) {
   const int back_rank = point_of_view == kWhite ? 7 : 0;
-  if (move_gen_type != MoveGenType::Fast || GetSquareY(des) != back_rank) {
+  if (move_gen_type == MoveGenType::Normal || GetSquareY(des) != back_rank) {
     moves.emplace_back(GetMove(src, des, move_type));
   }
   else {
@@ -267,7 +316,7 @@ inline void ConditionalAddPromotionMoves(const Square src, const Square des,
 }
 
 inline void AddNonPromotionMovesLoop(BitBoard des, const Square square_dif,
-                                     std::vector<Move> &moves,
+                                     MoveList &moves,
                                      const MoveType move_type) {
   for (; des; bitops::PopLSB(des)) {
     const Square destination = bitops::NumberOfTrailingZeros(des);
@@ -277,7 +326,7 @@ inline void AddNonPromotionMovesLoop(BitBoard des, const Square square_dif,
 
 template<int Quiescent, MoveGenType move_gen_type, Color point_of_view>
 inline void AddPawnMovesLoop(BitBoard des, const Square square_dif,
-                             std::vector<Move> &moves,
+                             MoveList &moves,
                              const MoveType move_type) {
   for (; des; bitops::PopLSB(des)) {
     const Square destination = bitops::NumberOfTrailingZeros(des);
@@ -289,7 +338,7 @@ inline void AddPawnMovesLoop(BitBoard des, const Square square_dif,
 template<int Quiescent, MoveGenType move_gen_type, Color point_of_view>
 inline void AddPawnMoves(const BitBoard pawn_bb, const BitBoard empty,
                          const BitBoard enemy_pieces, const Square en_passant,
-                         std::vector<Move> &moves, const BitBoard critical) {
+                         MoveList &moves, const BitBoard critical) {
   const BitBoard double_push_row = point_of_view == kWhite ? bitops::fourth_rank : bitops::fifth_rank;
   const int f_east = point_of_view == kWhite ? kNorthEast : kSouthEast;
   const int f_west = point_of_view == kWhite ? kNorthWest : kSouthWest;
@@ -363,9 +412,10 @@ Board::Board() {
   hash = 0;
   hash_p = 0;
   hash_pm = 0;
-  previous_hashes.clear();
+  num_made_moves = 0;
   en_passant = 0;
   fifty_move_count = 0;
+  plies_since_null = 0;
   phase = 0;
   for (int player = kWhite; player <= kBlack; ++player) {
     color_bitboards[player] = 0;
@@ -375,11 +425,16 @@ Board::Board() {
   }
   for (int piece_type = 0; piece_type < kNumPieceTypes - 1; ++piece_type) {
     pt_bitboards[piece_type] = 0;
+    attacks[kWhite][piece_type] = 0;
+    attacks[kBlack][piece_type] = 0;
   }
+  changed_squares = 0;
+  changed_pieces = 0;
 
   for (Square square = parse::StringToSquare("a1");
       square <= parse::StringToSquare("h8"); ++square) {
     pieces[square] = kNoPiece;
+    square_attacks[square] = 0;
   }
   for (Color color = kWhite; color <= kBlack; ++color) {
     AddPiece(parse::StringToSquare("a1") + (56*color), GetPiece(color, kRook));
@@ -471,14 +526,13 @@ std::vector<std::string> Board::GetFen() const {
 }
 
 void Board::SetBoard(std::vector<std::string> fen_tokens){
-  move_history.clear();
-  move_history_information.clear();
-  previous_hashes.clear();
+  num_made_moves = 0;
   hash = 0;
   hash_p = 0;
   hash_pm = 0;
   en_passant = 0;
   fifty_move_count = 0;
+  plies_since_null = 0;
   phase = 0;
   for (int player = kWhite; player <= kBlack; ++player) {
     color_bitboards[player] = 0;
@@ -488,10 +542,15 @@ void Board::SetBoard(std::vector<std::string> fen_tokens){
   }
   for (int piece_type = 0; piece_type < kNumPieceTypes - 1; ++piece_type) {
     pt_bitboards[piece_type] = 0;
+    attacks[kWhite][piece_type] = 0;
+    attacks[kBlack][piece_type] = 0;
   }
+  changed_squares = 0;
+  changed_pieces = 0;
   for (Square square = parse::StringToSquare("a1");
        square <= parse::StringToSquare("h8"); ++square) {
     pieces[square] = kNoPiece;
+    square_attacks[square] = 0;
   }
 
   std::vector<std::string> fen_position_rows = parse::split(fen_tokens[0], '/');
@@ -584,9 +643,13 @@ void Board::SetToSamePosition(const Board &board) {
   hash_pm = board.hash_pm;
   en_passant = board.en_passant;
   fifty_move_count = board.fifty_move_count;
-  move_history = board.move_history;
-  move_history_information = board.move_history_information;
-  previous_hashes = board.previous_hashes;
+  plies_since_null = board.plies_since_null;
+  if (state_stack.size() < board.num_made_moves) {
+    state_stack.resize(board.num_made_moves);
+  }
+  std::copy(board.state_stack.begin(), board.state_stack.begin() + board.num_made_moves,
+            state_stack.begin());
+  num_made_moves = board.num_made_moves;
   phase = board.phase;
   for (int player = kWhite; player <= kBlack; player++) {
     color_bitboards[player] = board.color_bitboards[player];
@@ -600,22 +663,35 @@ void Board::SetToSamePosition(const Board &board) {
   for (Square square = parse::StringToSquare("a1");
       square <= parse::StringToSquare("h8"); square++) {
     pieces[square] = board.pieces[square];
+    square_attacks[square] = board.square_attacks[square];
+  }
+  for (int piece_type = 0; piece_type < kNumPieceTypes - 1; ++piece_type) {
+    attacks[kWhite][piece_type] = board.attacks[kWhite][piece_type];
+    attacks[kBlack][piece_type] = board.attacks[kBlack][piece_type];
   }
+  changed_squares = board.changed_squares;
+  changed_pieces = board.changed_pieces;
   castling_rights = board.castling_rights;
   turn = board.turn;
 }
 
+template<bool update_hash>
 void Board::AddPiece(const Square square, const Piece piece) {
   pt_bitboards[GetPieceType(piece)] |= GetSquareBitBoard(square);
   color_bitboards[GetPieceColor(piece)] |= GetSquareBitBoard(square);
   piece_counts[GetPieceColor(piece)][GetPieceType(piece)]++;
   phase += piece_phases[GetPieceType(piece)];
   pieces[square] = piece;
-  hash ^= hash::get_hash(piece, square);
-  hash_p ^= hash::get_pawn_hash(piece, square);
-  hash_pm ^= hash::get_pawn_hash_mirrored(piece, square);
+  changed_squares |= GetSquareBitBoard(square);
+  changed_pieces |= 0x1 << piece;
+  if (update_hash) {
+    hash ^= hash::get_hash(piece, square);
+    hash_p ^= hash::get_pawn_hash(piece, square);
+    hash_pm ^= hash::get_pawn_hash_mirrored(piece, square);
+  }
 }
 
+template<bool update_hash>
 Piece Board::RemovePiece(const Square square) {
   Piece piece = pieces[square];
   if (GetPieceType(piece) != kNoPiece) {
@@ -624,39 +700,106 @@ Piece Board::RemovePiece(const Square square) {
     color_bitboards[GetPieceColor(piece)] ^= GetSquareBitBoard(square);
     piece_counts[GetPieceColor(piece)][GetPieceType(piece)]--;
     phase -= piece_phases[GetPieceType(piece)];
-    hash ^= hash::get_hash(piece, square);
-    hash_p ^= hash::get_pawn_hash(piece, square);
-    hash_pm ^= hash::get_pawn_hash_mirrored(piece, square);
+    changed_squares |= GetSquareBitBoard(square);
+    changed_pieces |= 0x1 << piece;
+    if (update_hash) {
+      hash ^= hash::get_hash(piece, square);
+      hash_p ^= hash::get_pawn_hash(piece, square);
+      hash_pm ^= hash::get_pawn_hash_mirrored(piece, square);
+    }
   }
   return piece;
 }
 
+template<bool update_hash>
 Piece Board::MovePiece(const Square source, const Square destination) {
-  Piece piece = RemovePiece(destination);
-  AddPiece(destination, RemovePiece(source));
+  Piece piece = RemovePiece<update_hash>(destination);
+  AddPiece<update_hash>(destination, RemovePiece<update_hash>(source));
   assert(pieces[source] == kNoPiece);
   assert(pieces[destination] != kNoPiece);
   return piece;
 }
 
+void Board::UpdateAttacks() const {
+  if (magic::GetSliderIndexing() == magic::SliderIndexing::kPext) {
+    UpdateAttacks<magic::SliderIndexing::kPext>();
+  }
+  else {
+    UpdateAttacks<magic::SliderIndexing::kMagic>();
+  }
+}
+
+template<magic::SliderIndexing indexing>
+void Board::UpdateAttacks() const {
+  const BitBoard all_pieces = get_all_pieces();
+  //A slider's attacks can only change if one of its rays reached a changed square.
+  for (BitBoard sliders = (pt_bitboards[kBishop] | pt_bitboards[kRook] | pt_bitboards[kQueen])
+                          & ~changed_squares; sliders; bitops::PopLSB(sliders)) {
+    const Square square = bitops::NumberOfTrailingZeros(sliders);
+    if (square_attacks[square] & changed_squares) {
+      changed_squares |= GetSquareBitBoard(square);
+      changed_pieces |= 0x1 << pieces[square];
+    }
+  }
+  for (BitBoard squares = changed_squares; squares; bitops::PopLSB(squares)) {
+    const Square square = bitops::NumberOfTrailingZeros(squares);
+    square_attacks[square] = GetPieceAttacks<indexing>(pieces[square], square, all_pieces);
+  }
+  for (uint16_t changed = changed_pieces; changed; changed &= changed - 1) {
+    const Piece piece = bitops::NumberOfTrailingZeros(changed);
+    const Color color = GetPieceColor(piece);
+    const PieceType piece_type = GetPieceType(piece);
+    BitBoard piece_attacks = 0;
+    if (piece_type == kPawn) {
+      const BitBoard pawns = get_piece_bitboard(color, kPawn);
+      piece_attacks = color == kWhite ? bitops::NE(pawns) | bitops::NW(pawns)
+                                      : bitops::SE(pawns) | bitops::SW(pawns);
+    }
+    else {
+      for (BitBoard bb = get_piece_bitboard(color, piece_type); bb; bitops::PopLSB(bb)) {
+        piece_attacks |= square_attacks[bitops::NumberOfTrailingZeros(bb)];
+      }
+    }
+    attacks[color][piece_type] = piece_attacks;
+  }
+  changed_squares = 0;
+  changed_pieces = 0;
+}
+
 void Board::SwapTurn() {
   turn ^= 0x1;
   hash ^= hash::get_color_hash();
 }
 
+Board::PlyState &Board::PushState(const Move move) {
+  if (num_made_moves == state_stack.size()) {
+    state_stack.emplace_back();
+  }
+  PlyState &state = state_stack[num_made_moves++];
+  state.key = get_hash();
+  state.hash = hash;
+  state.hash_p = hash_p;
+  state.hash_pm = hash_pm;
+  state.move = move;
+  state.captured_piece = kNoPiece;
+  state.en_passant = en_passant;
+  state.castling_rights = castling_rights;
+  state.fifty_move_count = fifty_move_count;
+  state.plies_since_null = plies_since_null;
+  return state;
+}
+
 void Board::Make(const Move move) {
-  MoveHistoryInformation information = 0;
-  previous_hashes.emplace_back(get_hash());
-  if (!settings::kUseNullMoves || move != kNullMove) {
-    SaveMovingPiece(information, RemovePiece(GetMoveDestination(move)));
-    MovePiece(GetMoveSource(move),GetMoveDestination(move));
-  }
-  SaveEnPassant(information, en_passant);
-  SaveCastlingRights(information, castling_rights);
-  SaveFiftyMoveCount(information, fifty_move_count);
+  if (move == kNullMove) {
+    MakeNullMove();
+    return;
+  }
+  PlyState &state = PushState(move);
+  state.captured_piece = MovePiece(GetMoveSource(move), GetMoveDestination(move));
   //We default our ep square to a place the opponent will never be able to ep.
   en_passant = 0;
   fifty_move_count++;
+  plies_since_null++;
   if (GetPieceType(pieces[GetMoveDestination(move)]) == kPawn
       || GetMoveType(move) == kCapture) {
     fifty_move_count = 0;
@@ -686,60 +829,67 @@ void Board::Make(const Move move) {
     }
     break;
   }
-  if (move != kNullMove) {
-    BitBoard srcdes = GetSquareBitBoard(GetMoveSource(move))
-                    | GetSquareBitBoard(GetMoveDestination(move));
-    if (srcdes & all_castling_squares) {
-      for (int right = 0; right < 4; right++) {
-        if (castling_relevant_bbs[right] & srcdes) {
-          castling_rights &= ~(0x1 << right);
-        }
+  BitBoard srcdes = GetSquareBitBoard(GetMoveSource(move))
+                  | GetSquareBitBoard(GetMoveDestination(move));
+  if (srcdes & all_castling_squares) {
+    for (int right = 0; right < 4; right++) {
+      if (castling_relevant_bbs[right] & srcdes) {
+        castling_rights &= ~(0x1 << right);
       }
     }
   }
-  move_history_information.emplace_back(information);
-  move_history.emplace_back(move);
   SwapTurn();
 }
 
-void Board::UnMake() {
+void Board::MakeNullMove() {
+  PushState(kNullMove);
+  en_passant = 0;
+  fifty_move_count++;
+  plies_since_null = 0;
   SwapTurn();
-  Move move = move_history.back();
-  move_history.pop_back();
-  MoveHistoryInformation info = move_history_information.back();
-  move_history_information.pop_back();
-  previous_hashes.pop_back();
+}
+
+void Board::UnMake() {
+  const PlyState &state = state_stack[--num_made_moves];
+  const Move move = state.move;
+  turn ^= 0x1;
+  //Hashes are restored from the state stack, so pieces are moved back without updating them.
   if (move != kNullMove) {
-    AddPiece(GetMoveSource(move), RemovePiece(GetMoveDestination(move)));
-    Piece piece = GetMovingPiece(info);
-    if (GetPieceType(piece) != kNoPiece) {
-      AddPiece(GetMoveDestination(move), piece);
-    }
-  }
-  en_passant = GetEnPassant(info);
-  castling_rights = GetCastlingRights(info);
-  fifty_move_count = GetFiftyMoveCount(info);
-  switch(GetMoveType(move)) {
-  case kEnPassant:
-    AddPiece(GetMoveDestination(move) - 8 + (2*8) * get_turn(), GetPiece(get_not_turn(), kPawn));
-    break;
-  case kCastle:
-    if (GetMoveDestination(move) < GetMoveSource(move)) {
-      //Queen-side castling
-      MovePiece(GetMoveSource(move)-1, GetMoveSource(move)-4);
+    const Square source = GetMoveSource(move);
+    const Square destination = GetMoveDestination(move);
+    AddPiece<false>(source, RemovePiece<false>(destination));
+    if (GetPieceType(state.captured_piece) != kNoPiece) {
+      AddPiece<false>(destination, state.captured_piece);
     }
-    else {
-      //King-side castling
-      MovePiece(GetMoveSource(move)+1, GetMoveSource(move)+3);
-    }
-    break;
-  default:
-    if (GetMoveType(move) >= kKnightPromotion) {
-      RemovePiece(GetMoveSource(move));
-      AddPiece(GetMoveSource(move), GetPiece(get_turn(), kPawn));
+    switch(GetMoveType(move)) {
+    case kEnPassant:
+      AddPiece<false>(destination - 8 + (2*8) * get_turn(), GetPiece(get_not_turn(), kPawn));
+      break;
+    case kCastle:
+      if (destination < source) {
+        //Queen-side castling
+        MovePiece<false>(source-1, source-4);
+      }
+      else {
+        //King-side castling
+        MovePiece<false>(source+1, source+3);
+      }
+      break;
+    default:
+      if (GetMoveType(move) >= kKnightPromotion) {
+        RemovePiece<false>(source);
+        AddPiece<false>(source, GetPiece(get_turn(), kPawn));
+      }
+      break;
     }
-    break;
   }
+  hash = state.hash;
+  hash_p = state.hash_p;
+  hash_pm = state.hash_pm;
+  en_passant = state.en_passant;
+  castling_rights = state.castling_rights;
+  fifty_move_count = state.fifty_move_count;
+  plies_since_null = state.plies_since_null;
 }
 
 void Board::Print() const {
@@ -766,16 +916,24 @@ void Board::Print() const {
   std::cout << std::endl;
 }
 
-template<PieceType pt>
+template<PieceType pt, magic::SliderIndexing indexing>
 inline BitBoard get_pt_control(BitBoard pieces, BitBoard all_pieces) {
   BitBoard under_control = 0;
   for (/* pieces init */; pieces; bitops::PopLSB(pieces)) {
     Square piece_square = bitops::NumberOfTrailingZeros(pieces);
-    under_control |= magic::GetAttackMap<pt>(piece_square, all_pieces);
+    under_control |= magic::GetAttackMap<pt, indexing>(piece_square, all_pieces);
   }
   return under_control;
 }
 
+BitBoard Board::PlayerBitBoardControl(Color color, BitBoard all_pieces) const {
+  if (magic::GetSliderIndexing() == magic::SliderIndexing::kPext) {
+    return PlayerBitBoardControl<magic::SliderIndexing::kPext>(color, all_pieces);
+  }
+  return PlayerBitBoardControl<magic::SliderIndexing::kMagic>(color, all_pieces);
+}
+
+template<magic::SliderIndexing indexing>
 BitBoard Board::PlayerBitBoardControl(Color color, BitBoard all_pieces) const {
   BitBoard under_control = color == kWhite ? bitops::NE(get_piece_bitboard(kWhite, kPawn))
                                            | bitops::NW(get_piece_bitboard(kWhite, kPawn))
@@ -783,198 +941,209 @@ BitBoard Board::PlayerBitBoardControl(Color color, BitBoard all_pieces) const {
                                            | bitops::SW(get_piece_bitboard(kBlack, kPawn));
 
   Square king_square = bitops::NumberOfTrailingZeros(get_piece_bitboard(color, kKing));
-  under_control  |= magic::GetAttackMap<kKing>(king_square, all_pieces)
-                 | get_pt_control<kKnight>(get_piece_bitboard(color, kKnight), all_pieces)
-                 | get_pt_control<kBishop>(get_piece_bitboard(color, kBishop), all_pieces)
-                 | get_pt_control<kRook>(get_piece_bitboard(color, kRook), all_pieces)
-                 | get_pt_control<kQueen>(get_piece_bitboard(color, kQueen), all_pieces);
+  under_control  |= magic::GetAttackMap<kKing, indexing>(king_square, all_pieces)
+                 | get_pt_control<kKnight, indexing>(get_piece_bitboard(color, kKnight), all_pieces)
+                 | get_pt_control<kBishop, indexing>(get_piece_bitboard(color, kBishop), all_pieces)
+                 | get_pt_control<kRook, indexing>(get_piece_bitboard(color, kRook), all_pieces)
+                 | get_pt_control<kQueen, indexing>(get_piece_bitboard(color, kQueen), all_pieces);
 
   return under_control;
 }
 
-template<int Quiescent, int _move_gen_type>
-std::vector<Move> Board::GetMoves(const BitBoard critical) {
-  constexpr MoveGenType move_gen_type = static_cast<MoveGenType>(_move_gen_type);
-  std::vector<Move> moves;
-  std::vector<Move> legal_moves;
+template<magic::SliderIndexing indexing>
+BitBoard Board::GetAttackersTo(const Square target, const BitBoard all_pieces) const {
+  const BitBoard target_bb = GetSquareBitBoard(target);
+  BitBoard attackers = (bitops::SE(target_bb) | bitops::SW(target_bb)) & get_piece_bitboard(kWhite, kPawn);
+  attackers |= (bitops::NE(target_bb) | bitops::NW(target_bb)) & get_piece_bitboard(kBlack, kPawn);
+  attackers |= magic::GetAttackMap<kKnight, indexing>(target, all_pieces) & pt_bitboards[kKnight];
+  attackers |= magic::GetAttackMap<kBishop, indexing>(target, all_pieces) & (pt_bitboards[kBishop] | pt_bitboards[kQueen]);
+  attackers |= magic::GetAttackMap<kRook, indexing>(target, all_pieces) & (pt_bitboards[kRook] | pt_bitboards[kQueen]);
+  attackers |= magic::GetAttackMap<kKing, indexing>(target, all_pieces) & pt_bitboards[kKing];
+  return attackers & all_pieces;
+}
 
-  const int expected_num_moves = Quiescent == kQuiescent ? 16 : 48;
-  if (move_gen_type == MoveGenType::InCheck) {
-    legal_moves.reserve(expected_num_moves / 4);
-    moves.reserve(expected_num_moves / 2);
-  }
-  else if (move_gen_type == MoveGenType::Fast) {
-    moves.reserve(expected_num_moves);
-  }
-  else {
-    legal_moves.reserve(expected_num_moves);
-    moves.reserve(expected_num_moves);
-  }
+template<int Quiescent, int _move_gen_type, magic::SliderIndexing indexing>
+void Board::GetMoves(MoveList &legal_moves, const BitBoard critical) {
+  constexpr MoveGenType move_gen_type = static_cast<MoveGenType>(_move_gen_type);
+  // Only moves by pinned pieces and pawns in the normal case need to be checked for
+  // legality, in all other cases every generated move is legal.
+  MoveList pseudo_legal_moves;
+  MoveList &moves = move_gen_type == MoveGenType::Normal ? pseudo_legal_moves : legal_moves;
 
   const BitBoard own_pieces = color_bitboards[get_turn()];
   const BitBoard enemy_pieces = color_bitboards[get_not_turn()];
   const BitBoard all_pieces = own_pieces | enemy_pieces;
   const BitBoard empty = ~all_pieces;
-  AddMoves<Quiescent, move_gen_type, kKnight>(moves, legal_moves,
-      get_piece_bitboard(get_turn(), kKnight), own_pieces, enemy_pieces,
-      all_pieces, critical);
-  AddMoves<Quiescent, move_gen_type, kBishop>(moves, legal_moves,
-      get_piece_bitboard(get_turn(), kBishop), own_pieces, enemy_pieces,
-      all_pieces, critical);
-  AddMoves<Quiescent, move_gen_type, kRook>(moves, legal_moves,
-      get_piece_bitboard(get_turn(), kRook), own_pieces, enemy_pieces,
-      all_pieces, critical);
-  AddMoves<Quiescent, move_gen_type, kQueen>(moves, legal_moves,
-      get_piece_bitboard(get_turn(), kQueen), own_pieces, enemy_pieces,
-      all_pieces, critical);
-
-  //Pawns
-  if (get_turn() == kWhite) {
-    AddPawnMoves<Quiescent, move_gen_type, kWhite>(
-        get_piece_bitboard(kWhite, kPawn), empty, enemy_pieces, en_passant, moves, critical);
-  }
-  else {
-    AddPawnMoves<Quiescent, move_gen_type, kBlack>(
-        get_piece_bitboard(kBlack, kPawn), empty, enemy_pieces, en_passant, moves, critical);
+  const BitBoard king_bb = get_piece_bitboard(get_turn(), kKing);
+  const Square king_square = bitops::NumberOfTrailingZeros(king_bb);
+
+  //In check critical contains the checking piece and the squares between it and our
+  //king. In double check it is empty, as only king moves can be legal.
+  if (move_gen_type != MoveGenType::InCheck || critical) {
+    //Pinned pieces can never capture or block a checking piece.
+    const BitBoard movable = move_gen_type == MoveGenType::InCheck ?
+        own_pieces & ~GetPinnedPieces<indexing>(king_square) : own_pieces;
+    AddMoves<Quiescent, move_gen_type, kKnight, indexing>(moves, legal_moves,
+        pt_bitboards[kKnight] & movable, own_pieces, enemy_pieces,
+        all_pieces, critical);
+    AddMoves<Quiescent, move_gen_type, kBishop, indexing>(moves, legal_moves,
+        pt_bitboards[kBishop] & movable, own_pieces, enemy_pieces,
+        all_pieces, critical);
+    AddMoves<Quiescent, move_gen_type, kRook, indexing>(moves, legal_moves,
+        pt_bitboards[kRook] & movable, own_pieces, enemy_pieces,
+        all_pieces, critical);
+    AddMoves<Quiescent, move_gen_type, kQueen, indexing>(moves, legal_moves,
+        pt_bitboards[kQueen] & movable, own_pieces, enemy_pieces,
+        all_pieces, critical);
+
+    //Pawns. En passant captures in check are rare and may resolve a check in ways
+    //not covered by critical, so they are handled separately below.
+    const Square ep_square = move_gen_type == MoveGenType::InCheck ? 0 : en_passant;
+    if (get_turn() == kWhite) {
+      AddPawnMoves<Quiescent, move_gen_type, kWhite>(
+          pt_bitboards[kPawn] & movable, empty, enemy_pieces, ep_square, moves, critical);
+    }
+    else {
+      AddPawnMoves<Quiescent, move_gen_type, kBlack>(
+          pt_bitboards[kPawn] & movable, empty, enemy_pieces, ep_square, moves, critical);
+    }
+    if (move_gen_type == MoveGenType::InCheck && en_passant) {
+      const BitBoard ep_bb = GetSquareBitBoard(en_passant);
+      BitBoard ep_captures = get_turn() == kWhite ? bitops::SE(ep_bb) | bitops::SW(ep_bb)
+                                                  : bitops::NE(ep_bb) | bitops::NW(ep_bb);
+      ep_captures &= get_piece_bitboard(get_turn(), kPawn);
+      for (; ep_captures; bitops::PopLSB(ep_captures)) {
+        const Move move = GetMove(bitops::NumberOfTrailingZeros(ep_captures), en_passant, kEnPassant);
+        if (IsMoveLegal<indexing>(move)) {
+          moves.emplace_back(move);
+        }
+      }
+    }
   }
 
-  //King
-  const Square king_square = bitops::NumberOfTrailingZeros(get_piece_bitboard(get_turn(), kKing));
-  BitBoard in_check = PlayerBitBoardControl(get_not_turn(), all_pieces);
-  const BitBoard king_destinations = magic::GetAttackMap<kKing>(king_square, all_pieces) & ~(own_pieces | in_check);
+  //King. In check the king must not be able to hide behind itself from a slider.
+  if (move_gen_type != MoveGenType::InCheck) {
+    RefreshAttacks<indexing>();
+  }
+  BitBoard in_check = move_gen_type == MoveGenType::InCheck ?
+      PlayerBitBoardControl<indexing>(get_not_turn(), all_pieces ^ king_bb) : get_all_attacks(get_not_turn());
+  const BitBoard king_destinations = magic::GetAttackMap<kKing, indexing>(king_square, all_pieces) & ~(own_pieces | in_check);
   if (move_gen_type != MoveGenType::Normal) {
     AddMoves<Quiescent>(moves, king_square, king_destinations, enemy_pieces);
   }
   else {
     AddMoves<Quiescent>(legal_moves, king_square, king_destinations, enemy_pieces);
   }
-  if (!Quiescent) {
+  if (!Quiescent && move_gen_type != MoveGenType::InCheck) {
     // Add castling moves
     for (int right = 0 + 2*get_turn(); right < 2+2*get_turn(); ++right) {
       if ((castling_rights & (0x1 << right))
           && !(castling_check_bbs[right] & in_check)
           && !(castling_empty_bbs[right] & all_pieces)) {
-        Square destination = king_square + 2 - (right%2)*4;
-        if (move_gen_type == MoveGenType::Normal) {
-          legal_moves.emplace_back(GetMove(king_square, destination, kCastle));
-        }
-        else {
-          moves.emplace_back(GetMove(king_square, destination, kCastle));
-        }
+        legal_moves.emplace_back(GetMove(king_square, king_square + 2 - (right%2)*4, kCastle));
       }
     }
   }
 
-  if (move_gen_type == MoveGenType::Fast) {
-    return moves;
+  if (move_gen_type != MoveGenType::Normal) {
+    return;
   }
 
-  //Now we need to remove illegal moves.
-  BitBoard dangerous_sources = magic::GetAttackMap<kQueen>(king_square, all_pieces)
-      | get_piece_bitboard(get_turn(), kKing);
+  //Now we need to remove illegal moves. Critical contains our pinned pieces,
+  //which may only move along the line through their king.
   for (Move move : moves) {
-    BitBoard move_src = GetSquareBitBoard(GetMoveSource(move));
-    bool add = false;
-    if (move_gen_type != MoveGenType::InCheck) {
-      if (!(dangerous_sources & move_src) && GetMoveType(move) != kEnPassant) {
-        add = true;
-      }
-      else {
-        Make(move);
-        SwapTurn();
-        if (!InCheck()) {
-          add = true;
-        }
-        SwapTurn();
-        UnMake();
-      }
+    const Square source = GetMoveSource(move);
+    const Square destination = GetMoveDestination(move);
+    bool add;
+    if (GetMoveType(move) == kEnPassant) {
+      add = IsMoveLegal<indexing>(move);
     }
     else {
-      Make(move);
-      SwapTurn();
-      if (!InCheck()) {
-        add = true;
-      }
-      SwapTurn();
-      UnMake();
+      add = !(GetSquareBitBoard(source) & critical)
+          || (GetSquareBitBoard(destination) & magic::GetLine(king_square, source));
     }
     if (add) {
-      if (GetPieceType(pieces[GetMoveSource(move)]) == kPawn
-          && (GetSquareY(GetMoveDestination(move)) - 7*(get_not_turn())) == 0) {
-        Square source = GetMoveSource(move);
-        Square destination = GetMoveDestination(move);
+      if (GetPieceType(pieces[source]) == kPawn
+          && (GetSquareY(destination) - 7*(get_not_turn())) == 0) {
         AddPromotionMoves<Quiescent>(source, destination, legal_moves);
       }
       else {
         legal_moves.emplace_back(move);
       }
     }
+  }
+}
 
+template<magic::SliderIndexing indexing>
+BitBoard Board::GetPinnedPieces(const Square king_square) const {
+  const BitBoard enemy_queens = get_piece_bitboard(get_not_turn(), kQueen);
+  BitBoard pinners = (magic::GetAttackMap<kRook, indexing>(king_square, 0)
+                        & (get_piece_bitboard(get_not_turn(), kRook) | enemy_queens))
+                   | (magic::GetAttackMap<kBishop, indexing>(king_square, 0)
+                        & (get_piece_bitboard(get_not_turn(), kBishop) | enemy_queens));
+  const BitBoard all_pieces = get_all_pieces();
+  BitBoard pinned = 0;
+  for (; pinners; bitops::PopLSB(pinners)) {
+    const BitBoard blockers = all_pieces
+        & magic::GetSquaresBetween(king_square, bitops::NumberOfTrailingZeros(pinners));
+    if (blockers && !(blockers & (blockers - 1))) {
+      pinned |= blockers;
+    }
   }
-  return legal_moves;
+  return pinned & color_bitboards[get_turn()];
 }
 
 template<int Quiescent>
-std::vector<Move> Board::GetMoves() {
+MoveList Board::GetMoves() {
+  if (magic::GetSliderIndexing() == magic::SliderIndexing::kPext) {
+    return GetMoves<Quiescent, magic::SliderIndexing::kPext>();
+  }
+  return GetMoves<Quiescent, magic::SliderIndexing::kMagic>();
+}
+
+template<int Quiescent, magic::SliderIndexing indexing>
+MoveList Board::GetMoves() {
+  MoveList moves;
   Square king_square = bitops::NumberOfTrailingZeros(get_piece_bitboard(get_turn(), kKing));
-  BitBoard danger = magic::GetAttackMap<kKnight>(king_square, 0) & get_piece_bitboard(get_not_turn(), kKnight);
-  danger |= magic::GetAttackMap<kRook>(king_square, 0)
+  BitBoard danger = magic::GetAttackMap<kKnight, indexing>(king_square, 0) & get_piece_bitboard(get_not_turn(), kKnight);
+  danger |= magic::GetAttackMap<kRook, indexing>(king_square, 0)
       & (get_piece_bitboard(get_not_turn(), kRook) | get_piece_bitboard(get_not_turn(), kQueen));
-  danger |= magic::GetAttackMap<kBishop>(king_square, 0)
+  danger |= magic::GetAttackMap<kBishop, indexing>(king_square, 0)
       & (get_piece_bitboard(get_not_turn(), kBishop) | get_piece_bitboard(get_not_turn(), kQueen));
   BitBoard enemy_pawns = get_piece_bitboard(get_not_turn(), kPawn);
   danger |= ((bitops::SE(enemy_pawns) | bitops::SW(enemy_pawns)) << (16 * get_turn()))
       & get_piece_bitboard(get_turn(), kKing);
   if (!danger) {
-    return GetMoves<Quiescent, static_cast<int>(MoveGenType::Fast)>();
+    GetMoves<Quiescent, static_cast<int>(MoveGenType::Fast), indexing>(moves);
+    return moves;
   }
 
-  danger = magic::GetAttackMap<kKnight>(king_square, 0) & get_piece_bitboard(get_not_turn(), kKnight);
-  BitBoard king = get_piece_bitboard(get_turn(), kKing);
-  if (get_turn() == kWhite) {
-    danger |= (bitops::NE(king) | bitops::NW(king)) & enemy_pawns;
-  }
-  else {
-    danger |= (bitops::SE(king) | bitops::SW(king)) & enemy_pawns;
-  }
-  if (danger) {
-    return GetMoves<kNonQuiescent, static_cast<int>(MoveGenType::InCheck)>(danger);
+  const BitBoard checkers = GetAttackersTo<indexing>(king_square, get_all_pieces()) & color_bitboards[get_not_turn()];
+  if (checkers) {
+    BitBoard evasion_targets = 0;
+    if (!(checkers & (checkers - 1))) {
+      evasion_targets = checkers
+          | magic::GetSquaresBetween(king_square, bitops::NumberOfTrailingZeros(checkers));
+    }
+    GetMoves<kNonQuiescent, static_cast<int>(MoveGenType::InCheck), indexing>(moves, evasion_targets);
+    return moves;
   }
 
-  BitBoard own_pieces = color_bitboards[get_turn()];
-  BitBoard enemy_pieces = color_bitboards[get_not_turn()];
-  BitBoard all_pieces = own_pieces | enemy_pieces;
+  GetMoves<Quiescent, static_cast<int>(MoveGenType::Normal), indexing>(moves, GetPinnedPieces<indexing>(king_square));
+  return moves;
+}
 
-  danger |= magic::GetAttackMap<kRook>(king_square, all_pieces)
-      & (get_piece_bitboard(get_not_turn(), kRook) | get_piece_bitboard(get_not_turn(), kQueen));
-  if (danger) {
-    return GetMoves<kNonQuiescent, static_cast<int>(MoveGenType::InCheck)>(
-        magic::GetAttackMap<kRook>(king_square, all_pieces));
-  }
-  danger |= magic::GetAttackMap<kBishop>(king_square, all_pieces)
-      & (get_piece_bitboard(get_not_turn(), kBishop) | get_piece_bitboard(get_not_turn(), kQueen));
+template MoveList Board::GetMoves<kNonQuiescent>();
+template MoveList Board::GetMoves<kQuiescent>();
 
-  if (danger) {
-    return GetMoves<kNonQuiescent, static_cast<int>(MoveGenType::InCheck)>(
-        magic::GetAttackMap<kBishop>(king_square, all_pieces));
-  }
-  BitBoard possibly_pinned = 0;
-  const BitBoard rook_attacks = magic::GetAttackMap<kRook>(king_square, 0);
-  if (rook_attacks & (get_piece_bitboard(get_not_turn(), kRook)
-                    | get_piece_bitboard(get_not_turn(), kQueen))) {
-    possibly_pinned |= rook_attacks & own_pieces;
-  }
-  const BitBoard bishop_attacks = magic::GetAttackMap<kBishop>(king_square, 0);
-  if (bishop_attacks & (get_piece_bitboard(get_not_turn(), kBishop)
-                    | get_piece_bitboard(get_not_turn(), kQueen))) {
-    possibly_pinned |= bishop_attacks & own_pieces;
+bool Board::InCheck() const {
+  if (magic::GetSliderIndexing() == magic::SliderIndexing::kPext) {
+    return InCheck<magic::SliderIndexing::kPext>();
   }
-  return GetMoves<Quiescent, static_cast<int>(MoveGenType::Normal)>(possibly_pinned);
+  return InCheck<magic::SliderIndexing::kMagic>();
 }
 
-template std::vector<Move> Board::GetMoves<kNonQuiescent>();
-template std::vector<Move> Board::GetMoves<kQuiescent>();
-
+template<magic::SliderIndexing indexing>
 bool Board::InCheck() const {
   Color not_color = get_not_turn();
   BitBoard king_bb = get_piece_bitboard(get_turn(), kKing);
@@ -984,64 +1153,38 @@ bool Board::InCheck() const {
   ptargeted &= king_bb;
 
   int index = bitops::NumberOfTrailingZeros(king_bb);
-  BitBoard targeted = (magic::GetAttackMap<kKing>(index, 0)
+  BitBoard targeted = (magic::GetAttackMap<kKing, indexing>(index, 0)
                         & get_piece_bitboard(not_color, kKing))
-                      | (magic::GetAttackMap<kKnight>(index, 0)
+                      | (magic::GetAttackMap<kKnight, indexing>(index, 0)
                           & get_piece_bitboard(not_color, kKnight))
-                      | (magic::GetAttackMap<kBishop>(index, all_pieces)
+                      | (magic::GetAttackMap<kBishop, indexing>(index, all_pieces)
                           & (get_piece_bitboard(not_color, kBishop) | get_piece_bitboard(not_color, kQueen)))
-                      | (magic::GetAttackMap<kRook>(index, all_pieces)
+                      | (magic::GetAttackMap<kRook, indexing>(index, all_pieces)
                           & (get_piece_bitboard(not_color, kRook) | get_piece_bitboard(not_color, kQueen)));
 
   return ptargeted | targeted;
 }
 
-bool Board::MoveInListCanRepeat(const std::vector<Move> moves) {
-  HashType mhash = get_hash() ^ hash::get_color_hash();
-  std::vector<HashType> potential_hashes = std::vector<HashType>();
-  potential_hashes.reserve(moves.size());
-  for (Move move : moves) {
-    if (GetMoveType(move) != kNormalMove) {
-      continue;
-    }
-    int src = GetMoveSource(move);
-    Piece piece = pieces[src];
-    if (GetPieceType(piece) == kPawn) {
-      continue;
-    }
-    int des = GetMoveDestination(move);
-    HashType pot_hash = (mhash ^ hash::get_hash(piece, src)) ^ hash::get_hash(piece, des);
-    potential_hashes.emplace_back(pot_hash);
-  }
-  std::vector<HashType> pre_hashes = std::vector<HashType>();
-  pre_hashes.reserve(fifty_move_count / 2);
-
-  int min_index = previous_hashes.size() - fifty_move_count;
-  if (min_index < 0) {
-    min_index = 0;
-  }
-  for (int index = previous_hashes.size()-1; index >= min_index; index -= 2) {
-    pre_hashes.emplace_back(previous_hashes[index]);
-  }
-
-  std::sort(pre_hashes.begin(), pre_hashes.end());
-  std::sort(potential_hashes.begin(), potential_hashes.end());
-
-  size_t i = 0, j = 0;
-  while (i < potential_hashes.size() && j < pre_hashes.size()) {
-    while (potential_hashes[i] < pre_hashes[j]) {
-      i++;
-      if (i >= potential_hashes.size()) {
-        return false;
+bool Board::HasUpcomingRepetition() const {
+  const HashType key = get_hash();
+  const int32_t max_distance = std::min<int32_t>(fifty_move_count, plies_since_null);
+  for (int32_t distance = 3; distance <= max_distance; distance += 2) {
+    const HashType move_key = key ^ state_stack[num_made_moves - distance].key;
+    size_t idx = cuckoo_h1(move_key);
+    if (cuckoo.keys[idx] != move_key) {
+      idx = cuckoo_h2(move_key);
+      if (cuckoo.keys[idx] != move_key) {
+        continue;
       }
     }
-    while (pre_hashes[j] < potential_hashes[i]) {
-      j++;
-      if (j >= pre_hashes.size()) {
-        return false;
-      }
+    const Square source = GetMoveSource(cuckoo.moves[idx]);
+    const Square destination = GetMoveDestination(cuckoo.moves[idx]);
+    if (magic::GetSquaresBetween(source, destination) & get_all_pieces()) {
+      continue;
     }
-    if (potential_hashes[i] == pre_hashes[j]) {
+    //The stored move may go in either direction, the moving piece must be ours.
+    const Piece piece = pieces[pieces[source] == kNoPiece ? destination : source];
+    if (GetPieceColor(piece) == get_turn()) {
       return true;
     }
   }
@@ -1050,15 +1193,15 @@ bool Board::MoveInListCanRepeat(const std::vector<Move> moves) {
 
 int32_t Board::CountRepetitions(int32_t min_ply) const {
   int32_t repetitions = 1; //We count the current position as a "repetition"
-  int32_t min_index = std::max(static_cast<int32_t>(previous_hashes.size()) - fifty_move_count, min_ply);
+  int32_t min_index = std::max(static_cast<int32_t>(num_made_moves) - fifty_move_count, min_ply);
   HashType cur_hash = get_hash();
-  for (int32_t index = previous_hashes.size()-2; index >= min_index; index-=2) {
-    repetitions += (cur_hash == previous_hashes[index]);
+  for (int32_t index = num_made_moves-2; index >= min_index; index-=2) {
+    repetitions += (cur_hash == state_stack[index].key);
   }
   return repetitions;
 }
 
-template<int piece_type>
+template<int piece_type, magic::SliderIndexing indexing>
 PieceType Board::next_see_attacker(const Color color, const Square target,
                                BitBoard &attackers, BitBoard &all_pieces) const {
 
@@ -1069,7 +1212,7 @@ PieceType Board::next_see_attacker(const Color color, const Square target,
   BitBoard pt_bitboard = attackers & get_piece_bitboard(color, piece_type);
   if (!pt_bitboard) {
     if (piece_type < kKing) {
-      return next_see_attacker<piece_type+1>(color, target, attackers, all_pieces);
+      return next_see_attacker<std::min(piece_type + 1, kKing), indexing>(color, target, attackers, all_pieces);
     }
     return kNoPiece;
   }
@@ -1079,14 +1222,14 @@ PieceType Board::next_see_attacker(const Color color, const Square target,
   all_pieces ^= next_attacker;
 
   if (piece_type == kPawn || piece_type == kBishop || piece_type == kQueen) {
-    BitBoard diagonals = magic::GetAttackMap<kBishop>(target, all_pieces)
+    BitBoard diagonals = magic::GetAttackMap<kBishop, indexing>(target, all_pieces)
                             & (pt_bitboards[kBishop] | pt_bitboards[kQueen])
                             & all_pieces;
     attackers |= diagonals;
   }
 
   if (piece_type == kRook || piece_type == kQueen) {
-    BitBoard verticals = magic::GetAttackMap<kRook>(target, all_pieces)
+    BitBoard verticals = magic::GetAttackMap<kRook, indexing>(target, all_pieces)
                             & (pt_bitboards[kRook] | pt_bitboards[kQueen])
                             & all_pieces;
     attackers |= verticals;
@@ -1095,12 +1238,14 @@ PieceType Board::next_see_attacker(const Color color, const Square target,
   return piece_type;
 }
 
-template<>
-PieceType Board::next_see_attacker<kNoPiece>(const Color color, const Square target,
-                               BitBoard &attackers, BitBoard &all_pieces) const {
-  return kNoPiece;
+bool Board::NonNegativeSEESquare(const Square target) const {
+  if (magic::GetSliderIndexing() == magic::SliderIndexing::kPext) {
+    return NonNegativeSEESquare<magic::SliderIndexing::kPext>(target);
+  }
+  return NonNegativeSEESquare<magic::SliderIndexing::kMagic>(target);
 }
 
+template<magic::SliderIndexing indexing>
 bool Board::NonNegativeSEESquare(const Square target) const {
   Color cturn = turn^0x1;
   BitBoard all_pieces = get_all_pieces();
@@ -1110,17 +1255,17 @@ bool Board::NonNegativeSEESquare(const Square target) const {
   BitBoard targetBB = GetSquareBitBoard(target);
   BitBoard attackers = (bitops::SE(targetBB) | bitops::SW(targetBB)) & get_piece_bitboard(kWhite, kPawn);
   attackers |= (bitops::NE(targetBB) | bitops::NW(targetBB)) & get_piece_bitboard(kBlack, kPawn);
-  attackers |= magic::GetAttackMap<kKnight>(target, all_pieces) & pt_bitboards[kKnight];
-  attackers |= magic::GetAttackMap<kBishop>(target, all_pieces) & (pt_bitboards[kBishop] | pt_bitboards[kQueen]);
-  attackers |= magic::GetAttackMap<kRook>(target, all_pieces) & (pt_bitboards[kRook] | pt_bitboards[kQueen]);
-  attackers |= magic::GetAttackMap<kKing>(target, all_pieces) & (pt_bitboards[kKing]);
+  attackers |= magic::GetAttackMap<kKnight, indexing>(target, all_pieces) & pt_bitboards[kKnight];
+  attackers |= magic::GetAttackMap<kBishop, indexing>(target, all_pieces) & (pt_bitboards[kBishop] | pt_bitboards[kQueen]);
+  attackers |= magic::GetAttackMap<kRook, indexing>(target, all_pieces) & (pt_bitboards[kRook] | pt_bitboards[kQueen]);
+  attackers |= magic::GetAttackMap<kKing, indexing>(target, all_pieces) & (pt_bitboards[kKing]);
   attackers &= all_pieces;
 
   while ((attackers & color_bitboards[cturn]) && score <= 0) {
     if (cturn == turn && score == 0) {
       return true;
     }
-    PieceType pt = next_see_attacker<kPawn>(cturn, target, attackers, all_pieces);
+    PieceType pt = next_see_attacker<kPawn, indexing>(cturn, target, attackers, all_pieces);
     score = -(score + victim);
     victim = see_values[pt];
     cturn ^= 0x1;
@@ -1129,6 +1274,14 @@ bool Board::NonNegativeSEESquare(const Square target) const {
   return (score >= 0 && cturn == get_turn()) || (score <= 0 && cturn == get_not_turn());
 }
 
+bool Board::NonNegativeSEE(const Move move) const {
+  if (magic::GetSliderIndexing() == magic::SliderIndexing::kPext) {
+    return NonNegativeSEE<magic::SliderIndexing::kPext>(move);
+  }
+  return NonNegativeSEE<magic::SliderIndexing::kMagic>(move);
+}
+
+template<magic::SliderIndexing indexing>
 bool Board::NonNegativeSEE(const Move move) const {
   Color cturn = turn^0x1;
   Square target = GetMoveDestination(move);
@@ -1140,16 +1293,16 @@ bool Board::NonNegativeSEE(const Move move) const {
   BitBoard targetBB = GetSquareBitBoard(target);
   BitBoard attackers = (bitops::SE(targetBB) | bitops::SW(targetBB)) & get_piece_bitboard(kWhite, kPawn);
   attackers |= (bitops::NE(targetBB) | bitops::NW(targetBB)) & get_piece_bitboard(kBlack, kPawn);
-  attackers |= magic::GetAttackMap<kKnight>(target, all_pieces) & pt_bitboards[kKnight];
-  attackers |= magic::GetAttackMap<kBishop>(target, all_pieces) & (pt_bitboards[kBishop] | pt_bitboards[kQueen]);
-  attackers |= magic::GetAttackMap<kRook>(target, all_pieces) & (pt_bitboards[kRook] | pt_bitboards[kQueen]);
-  attackers |= magic::GetAttackMap<kKing>(target, all_pieces) & (pt_bitboards[kKing]);
+  attackers |= magic::GetAttackMap<kKnight, indexing>(target, all_pieces) & pt_bitboards[kKnight];
+  attackers |= magic::GetAttackMap<kBishop, indexing>(target, all_pieces) & (pt_bitboards[kBishop] | pt_bitboards[kQueen]);
+  attackers |= magic::GetAttackMap<kRook, indexing>(target, all_pieces) & (pt_bitboards[kRook] | pt_bitboards[kQueen]);
+  attackers |= magic::GetAttackMap<kKing, indexing>(target, all_pieces) & (pt_bitboards[kKing]);
   attackers &= all_pieces;
   while ((attackers & color_bitboards[cturn]) && score <= 0) {
     if (cturn == turn && score == 0) {
       return true;
     }
-    PieceType pt = next_see_attacker<kPawn>(cturn, target, attackers, all_pieces);
+    PieceType pt = next_see_attacker<kPawn, indexing>(cturn, target, attackers, all_pieces);
     score = -(score + victim);
     victim = see_values[pt];
     cturn ^= 0x1;
@@ -1158,25 +1311,182 @@ bool Board::NonNegativeSEE(const Move move) const {
   return (score >= 0 && cturn == get_turn()) || (score <= 0 && cturn == get_not_turn());
 }
 
+template<magic::SliderIndexing indexing>
+NScore Board::GetSwapValue(const Move move, BitBoard attackers, BitBoard all_pieces) const {
+  const Square source = GetMoveSource(move);
+  const Square target = GetMoveDestination(move);
+  const BitBoard diagonal_sliders = pt_bitboards[kBishop] | pt_bitboards[kQueen];
+  const BitBoard straight_sliders = pt_bitboards[kRook] | pt_bitboards[kQueen];
+  std::array<NScore, 32> gain;
+  int depth = 0;
+  gain[0] = see_values[GetPieceType(get_piece(target))];
+  PieceType attacker = GetPieceType(get_piece(source));
+  BitBoard attacker_bb = GetSquareBitBoard(source);
+  //Pieces behind the first attacker are uncovered whatever it is.
+  bool uncovers_diagonal = true, uncovers_straight = true;
+  Color side = turn;
+  while (true) {
+    depth++;
+    gain[depth] = see_values[attacker] - gain[depth - 1];
+    all_pieces ^= attacker_bb;
+    attackers &= ~attacker_bb;
+    if (uncovers_diagonal) {
+      attackers |= magic::GetAttackMap<kBishop, indexing>(target, all_pieces) & diagonal_sliders & all_pieces;
+    }
+    if (uncovers_straight) {
+      attackers |= magic::GetAttackMap<kRook, indexing>(target, all_pieces) & straight_sliders & all_pieces;
+    }
+    side ^= 0x1;
+    const BitBoard side_attackers = attackers & color_bitboards[side];
+    if (!side_attackers || depth == static_cast<int>(gain.size()) - 1) {
+      break;
+    }
+    for (attacker = kPawn; !(side_attackers & pt_bitboards[attacker]); attacker++) {}
+    attacker_bb = bitops::GetLSB(side_attackers & pt_bitboards[attacker]);
+    uncovers_diagonal = attacker == kPawn || attacker == kBishop || attacker == kQueen;
+    uncovers_straight = attacker == kRook || attacker == kQueen;
+  }
+  while (--depth) {
+    gain[depth - 1] = -std::max(-gain[depth - 1], gain[depth]);
+  }
+  return gain[0];
+}
+
+NScore Board::SEE(const Move move) const {
+  const BitBoard all_pieces = get_all_pieces();
+  const Square target = GetMoveDestination(move);
+  if (magic::GetSliderIndexing() == magic::SliderIndexing::kPext) {
+    return GetSwapValue<magic::SliderIndexing::kPext>(move,
+        GetAttackersTo<magic::SliderIndexing::kPext>(target, all_pieces), all_pieces);
+  }
+  return GetSwapValue<magic::SliderIndexing::kMagic>(move,
+      GetAttackersTo<magic::SliderIndexing::kMagic>(target, all_pieces), all_pieces);
+}
+
+void Board::SEE(const MoveList &moves, NScore *values) const {
+  if (magic::GetSliderIndexing() == magic::SliderIndexing::kPext) {
+    SEE<magic::SliderIndexing::kPext>(moves, values);
+  }
+  else {
+    SEE<magic::SliderIndexing::kMagic>(moves, values);
+  }
+}
+
+template<magic::SliderIndexing indexing>
+void Board::SEE(const MoveList &moves, NScore *values) const {
+  const BitBoard all_pieces = get_all_pieces();
+  std::array<BitBoard, 64> attackers;
+  BitBoard computed = 0;
+  for (size_t i = 0; i < moves.size(); ++i) {
+    const Square target = GetMoveDestination(moves[i]);
+    if (!(computed & GetSquareBitBoard(target))) {
+      attackers[target] = GetAttackersTo<indexing>(target, all_pieces);
+      computed |= GetSquareBitBoard(target);
+    }
+    values[i] = GetSwapValue<indexing>(moves[i], attackers[target], all_pieces);
+  }
+}
+
 bool Board::IsMoveLegal(const Move move) const {
-  assert(false); // Not yet properly implemented
-  if (move == kNullMove) {
+  if (magic::GetSliderIndexing() == magic::SliderIndexing::kPext) {
+    return IsMoveLegal<magic::SliderIndexing::kPext>(move);
+  }
+  return IsMoveLegal<magic::SliderIndexing::kMagic>(move);
+}
+
+template<magic::SliderIndexing indexing>
+bool Board::IsMoveLegal(const Move move) const {
+  const Square source = GetMoveSource(move);
+  const Square destination = GetMoveDestination(move);
+  const MoveType move_type = GetMoveType(move);
+  if (move == kNullMove || move_type > kQueenPromotion) {
     return false;
   }
-  Piece piece = get_piece(GetMoveSource(move));
+  const Piece piece = get_piece(source);
   if (GetPieceType(piece) == kNoPiece || GetPieceColor(piece) != get_turn()) {
     return false;
   }
-  switch (GetMoveType(move)) {
-    case kEnPassant:
-      if (!en_passant || en_passant != GetMoveDestination(move) || GetPieceType(piece) != kPawn) {
-        return false;
-      }
-      return true;
+  const PieceType piece_type = GetPieceType(piece);
+  const BitBoard own_pieces = color_bitboards[get_turn()];
+  const BitBoard enemy_pieces = color_bitboards[get_not_turn()];
+  const BitBoard all_pieces = own_pieces | enemy_pieces;
+  const BitBoard des_bb = GetSquareBitBoard(destination);
+  if (des_bb & own_pieces) {
+    return false;
   }
-  return true;
+
+  if (move_type == kCastle) {
+    RefreshAttacks<indexing>();
+    const int right = 2 * get_turn() + (destination < source);
+    return piece_type == kKing && source == (get_turn() == kWhite ? 4 : 60)
+        && destination == source + 2 - (right % 2) * 4
+        && (castling_rights & (0x1 << right))
+        && !(castling_empty_bbs[right] & all_pieces)
+        && !(castling_check_bbs[right] & get_all_attacks(get_not_turn()));
+  }
+
+  //Check the move is pseudo legal and the move type matches the destination.
+  BitBoard captured = des_bb & enemy_pieces;
+  if (piece_type == kPawn) {
+    const int forward = get_turn() == kWhite ? 8 : -8;
+    const BitBoard back_rank = get_turn() == kWhite ? bitops::eighth_rank : bitops::first_rank;
+    const BitBoard src_bb = GetSquareBitBoard(source);
+    const BitBoard attacks = get_turn() == kWhite ? bitops::NE(src_bb) | bitops::NW(src_bb)
+                                                  : bitops::SE(src_bb) | bitops::SW(src_bb);
+    const bool is_push = destination == source + forward && !(des_bb & all_pieces);
+    const bool is_capture = (attacks & des_bb & enemy_pieces) != 0;
+    switch (move_type) {
+      case kNormalMove:
+        if (!is_push || (des_bb & back_rank)) {
+          return false;
+        }
+        break;
+      case kDoublePawnMove:
+        if (destination != source + 2 * forward
+            || !(src_bb & (get_turn() == kWhite ? bitops::second_rank : bitops::seventh_rank))
+            || (all_pieces & (des_bb | GetSquareBitBoard(source + forward)))) {
+          return false;
+        }
+        break;
+      case kEnPassant:
+        if (!en_passant || destination != en_passant || !(attacks & des_bb)) {
+          return false;
+        }
+        captured = GetSquareBitBoard(destination - forward);
+        break;
+      case kCapture:
+        if (!is_capture || (des_bb & back_rank)) {
+          return false;
+        }
+        break;
+      default:
+        if (!(des_bb & back_rank) || !(is_push || is_capture)) {
+          return false;
+        }
+    }
+  }
+  else if ((move_type != kNormalMove && move_type != kCapture)
+      || (move_type == kCapture) != static_cast<bool>(captured)
+      || !(des_bb & (piece_type == kKing ? magic::GetAttackMap<kKing, indexing>(source, all_pieces)
+                                         : magic::GetAttackMap<indexing>(piece_type, source, all_pieces)))) {
+    return false;
+  }
+
+  //Check the king is not attacked once the move has been made.
+  const BitBoard occupancy = (all_pieces ^ GetSquareBitBoard(source) ^ captured) | des_bb;
+  const Square king_square = piece_type == kKing ? destination
+      : bitops::NumberOfTrailingZeros(get_piece_bitboard(get_turn(), kKing));
+  return !(GetAttackersTo<indexing>(king_square, occupancy) & enemy_pieces & ~captured);
 }
 
+Vec<BitBoard, 6> Board::GetDirectCheckingSquares() const {
+  if (magic::GetSliderIndexing() == magic::SliderIndexing::kPext) {
+    return GetDirectCheckingSquares<magic::SliderIndexing::kPext>();
+  }
+  return GetDirectCheckingSquares<magic::SliderIndexing::kMagic>();
+}
+
+template<magic::SliderIndexing indexing>
 Vec<BitBoard, 6> Board::GetDirectCheckingSquares() const {
   Vec<BitBoard, 6> direct_checks;
   BitBoard king_bb = get_piece_bitboard(get_not_turn(), kKing);
@@ -1188,9 +1498,9 @@ Vec<BitBoard, 6> Board::GetDirectCheckingSquares() const {
   }
   Square square = bitops::NumberOfTrailingZeros(king_bb);
   BitBoard all_pieces = get_all_pieces();
-  direct_checks[kKnight] = magic::GetAttackMap<kKnight>(square, all_pieces);
-  direct_checks[kBishop] = magic::GetAttackMap<kBishop>(square, all_pieces);
-  direct_checks[kRook] = magic::GetAttackMap<kRook>(square, all_pieces);
+  direct_checks[kKnight] = magic::GetAttackMap<kKnight, indexing>(square, all_pieces);
+  direct_checks[kBishop] = magic::GetAttackMap<kBishop, indexing>(square, all_pieces);
+  direct_checks[kRook] = magic::GetAttackMap<kRook, indexing>(square, all_pieces);
   direct_checks[kQueen] = direct_checks[kBishop] | direct_checks[kRook];
   direct_checks[kKing] = 0;
   return direct_checks;
@@ -1198,33 +1508,22 @@ Vec<BitBoard, 6> Board::GetDirectCheckingSquares() const {
 
 Vec<BitBoard, 6> Board::GetTabooSquares() const {
   const Color not_turn = get_not_turn();
-  const BitBoard all_pieces = get_all_pieces();
   Vec<BitBoard, 6> taboo_squares;
-  BitBoard taboo;
-  if (get_turn() == kWhite) {
-    BitBoard bb = get_piece_bitboard(not_turn, kPawn);
-    taboo = bitops::SE(bb) | bitops::SW(bb);
-  }
-  else {
-    BitBoard bb = get_piece_bitboard(not_turn, kPawn);
-    taboo = bitops::NE(bb) | bitops::NW(bb);
-  }
+  RefreshAttacks();
+  BitBoard taboo = attacks[not_turn][kPawn];
   taboo_squares[kPawn] = 0;
   taboo_squares[kKnight] = taboo;
   taboo_squares[kBishop] = taboo;
 
-  taboo |= get_pt_control<kKnight>(get_piece_bitboard(not_turn, kKnight), all_pieces)
-         | get_pt_control<kBishop>(get_piece_bitboard(not_turn, kBishop), all_pieces);
+  taboo |= attacks[not_turn][kKnight] | attacks[not_turn][kBishop];
 
   taboo_squares[kRook] = taboo;
 
-  taboo |= get_pt_control<kRook>(get_piece_bitboard(not_turn, kRook), all_pieces);
+  taboo |= attacks[not_turn][kRook];
 
   taboo_squares[kQueen] = taboo;
 
-  taboo |= get_pt_control<kQueen>(get_piece_bitboard(not_turn, kQueen), all_pieces)
-         | magic::GetAttackMap<kKing>(bitops::NumberOfTrailingZeros(get_piece_bitboard(not_turn, kKing)),
-                                        all_pieces);
+  taboo |= attacks[not_turn][kQueen] | attacks[not_turn][kKing];
   taboo_squares[kKing] = taboo;
   return taboo_squares;
 }
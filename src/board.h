@@ -30,15 +30,40 @@
 #include "general/types.h"
 #include "general/parse.h"
 #include "general/bit_operations.h"
+#include "general/magic.h"
 #include "learning/linear_algebra.h"
+#include <array>
+#include <cassert>
 #include <vector>
 #include <iostream>
 
+constexpr size_t kMaxNumMoves = 256;
+
 /**
- * This type is used to store information which is necessary in order to
- * implement the unmake move function such as ep.
+ * Fixed capacity move list which lives on the stack, so generating moves at a
+ * node does not require any heap allocations. Moves only require 16 bits.
  */
-typedef int32_t MoveHistoryInformation;
+class MoveList {
+public:
+  MoveList() : length(0) {}
+  void emplace_back(const Move move) {
+    assert(length < kMaxNumMoves);
+    moves[length++] = move;
+  }
+  void clear() { length = 0; }
+  size_t size() const { return length; }
+  bool empty() const { return length == 0; }
+  uint16_t &operator[](const size_t idx) { return moves[idx]; }
+  Move operator[](const size_t idx) const { return moves[idx]; }
+  uint16_t *begin() { return moves.data(); }
+  uint16_t *end() { return moves.data() + length; }
+  const uint16_t *begin() const { return moves.data(); }
+  const uint16_t *end() const { return moves.data() + length; }
+
+private:
+  std::array<uint16_t, kMaxNumMoves> moves;
+  size_t length;
+};
 
 class Board {
 public:
@@ -50,13 +75,16 @@ public:
   void SetBoard(std::vector<std::string> fen_tokens);
   void evaluate_castling_rights(std::string fen_code);
   template<int Quiescent>
-  std::vector<Move> GetMoves();
+  MoveList GetMoves();
   void Make(const Move move);
+  void MakeNullMove();
   void UnMake();
   void SetStartBoard();
   HashType get_hash() const {
     return hash ^ (castling_rights | GetSquareBitBoard(en_passant + 8));
   }
+  //Digest of all zobrist keys, used to reject stored hash tables built with other keys.
+  static HashType GetZobristFingerprint();
   HashType get_pawn_hash() const {
     if (get_turn()) {
       return hash_pm;
@@ -84,7 +112,7 @@ public:
   int8_t get_num_pieces() const {
     return bitops::PopCount(color_bitboards[kWhite] | color_bitboards[kBlack]);
   }
-  size_t get_num_made_moves() const { return move_history.size(); }
+  size_t get_num_made_moves() const { return num_made_moves; }
   int32_t get_piece_count(const Color color, const PieceType piece_type) const {
     return piece_counts[color][piece_type];
   }
@@ -92,6 +120,20 @@ public:
     return piece_counts[kWhite][piece_type] + piece_counts[kBlack][piece_type];
   }
   CastlingRights get_castling_rights() const { return castling_rights; }
+  //Attack maps are brought up to date for the current occupancy on first read.
+  BitBoard get_attacks(const Color color, const PieceType piece_type) const {
+    RefreshAttacks();
+    return attacks[color][piece_type];
+  }
+  BitBoard get_all_attacks(const Color color) const {
+    RefreshAttacks();
+    return attacks[color][kPawn] | attacks[color][kKnight] | attacks[color][kBishop]
+         | attacks[color][kRook] | attacks[color][kQueen] | attacks[color][kKing];
+  }
+  BitBoard get_square_attacks(const Square square) const {
+    RefreshAttacks();
+    return square_attacks[square];
+  }
   int get_phase() const { return phase; }
   //Print unicode chess board.
   bool IsMoveLegal(const Move move) const;
@@ -111,8 +153,8 @@ public:
     parse::PrintBitboard(color_bitboards[kBlack]);
   }
   void PrintMadeMoves() const {
-    for (size_t i = 0; i < move_history.size(); i++) {
-      std::cout << parse::MoveToString(move_history[i]) << " ";
+    for (size_t i = 0; i < num_made_moves; i++) {
+      std::cout << parse::MoveToString(state_stack[i].move) << " ";
     }
     std::cout << std::endl;
   }
@@ -123,43 +165,124 @@ public:
   void SetToSamePosition(const Board &board);
   bool NonNegativeSEE(const Move move) const;
   bool NonNegativeSEESquare(const Square target) const;
+  //Exact static exchange value of move from the perspective of the side to move.
+  NScore SEE(const Move move) const;
+  //Writes the static exchange value of each move to values. Attackers of each
+  //destination are collected once and shared by all moves to it.
+  void SEE(const MoveList &moves, NScore *values) const;
 
   Board copy() const;
-  Move get_last_move() const { return move_history.back(); }
+  Move get_last_move() const { return state_stack[num_made_moves - 1].move; }
   BitBoard PlayerBitBoardControl(Color color, BitBoard all_pieces) const;
-  bool MoveInListCanRepeat(const std::vector<Move> moves);
+  //Returns true if the side to move has a reversible move back to an earlier position.
+  bool HasUpcomingRepetition() const;
   int32_t CountRepetitions(int32_t min_ply = 0) const;
 
 private:
-  template<int Quiescent, int MoveGenerationType>
-  std::vector<Move> GetMoves(BitBoard critical = 0);
+  /**
+   * Everything needed to restore the position before a move, including the hashes,
+   * so UnMake does not need to recompute anything. The key is the full position
+   * hash used for repetition detection.
+   */
+  struct PlyState {
+    HashType key;
+    HashType hash;
+    HashType hash_p;
+    HashType hash_pm;
+    int16_t fifty_move_count;
+    int16_t plies_since_null;
+    uint16_t move;
+    uint8_t captured_piece;
+    uint8_t en_passant;
+    uint8_t castling_rights;
+  };
+
+  //Slider lookups in the functions below are instantiated for each indexing scheme.
+  //The public functions of the same name pick the instantiation once per call.
+  template<int Quiescent, magic::SliderIndexing indexing>
+  MoveList GetMoves();
+  template<int Quiescent, int MoveGenerationType, magic::SliderIndexing indexing>
+  void GetMoves(MoveList &legal_moves, BitBoard critical = 0);
+  template<magic::SliderIndexing indexing>
+  bool InCheck() const;
+  template<magic::SliderIndexing indexing>
+  Vec<BitBoard, 6> GetDirectCheckingSquares() const;
+  template<magic::SliderIndexing indexing>
+  bool NonNegativeSEE(const Move move) const;
+  template<magic::SliderIndexing indexing>
+  bool NonNegativeSEESquare(const Square target) const;
+  template<magic::SliderIndexing indexing>
+  void SEE(const MoveList &moves, NScore *values) const;
+  template<magic::SliderIndexing indexing>
+  bool IsMoveLegal(const Move move) const;
+  template<magic::SliderIndexing indexing>
+  BitBoard PlayerBitBoardControl(Color color, BitBoard all_pieces) const;
   void SwapTurn();
+  PlyState &PushState(const Move move);
+  template<bool update_hash = true>
   void AddPiece(const Square square, const Piece piece);
+  template<bool update_hash = true>
   Piece RemovePiece(const Square square);
+  template<bool update_hash = true>
   Piece MovePiece(const Square source, const Square destination);
-  template<int piece_type>
+  //Recomputes attack maps of changed squares and sliders with rays through them.
+  void UpdateAttacks() const;
+  template<magic::SliderIndexing indexing>
+  void UpdateAttacks() const;
+  void RefreshAttacks() const {
+    if (changed_squares) {
+      UpdateAttacks();
+    }
+  }
+  template<magic::SliderIndexing indexing>
+  void RefreshAttacks() const {
+    if (changed_squares) {
+      UpdateAttacks<indexing>();
+    }
+  }
+  //Returns own pieces which are pinned to the king on king_square.
+  template<magic::SliderIndexing indexing>
+  BitBoard GetPinnedPieces(const Square king_square) const;
+  //Returns pieces of both colors attacking target given the occupancy all_pieces.
+  template<magic::SliderIndexing indexing>
+  BitBoard GetAttackersTo(const Square target, const BitBoard all_pieces) const;
+  //Swap list evaluation of move given all attackers of its destination.
+  template<magic::SliderIndexing indexing>
+  NScore GetSwapValue(const Move move, BitBoard attackers, BitBoard all_pieces) const;
+  template<int piece_type, magic::SliderIndexing indexing>
   PieceType next_see_attacker(const Color color, const Square target,
                               BitBoard &attackers, BitBoard &all_pieces) const;
-  //BitBoard piece_bitboards[kNumPlayers][kNumPieceTypes];
+  //Members are ordered by how often make and unmake touch them. The bitboards
+  //fill the first cache line and the hashes, scalar state and piece counts the
+  //second. The mailbox spans the end of the second line and most of the third,
+  //the state stack header starts the fourth. Apart from the PlyState on top of
+  //the stack, Make and UnMake touch nothing else. The attack maps are only
+  //written when they are read.
   BitBoard pt_bitboards[kNumPieceTypes - 1];
   BitBoard color_bitboards[kNumPlayers];
-  int8_t piece_counts[kNumPlayers][kNumPieceTypes - 1];
-  Piece pieces[kBoardLength*kBoardLength];
-  std::vector<Move> move_history;
-  std::vector<HashType> previous_hashes;
-  //Includes information necessary to restore a previous state.
-  std::vector<MoveHistoryInformation> move_history_information;
-  //4 bits are set representing white and black, queen- and kingside castling
-  CastlingRights castling_rights;
-  int phase;
-  Square en_passant;
-  Color turn;
-  //Ply refers to the number of played halfmoves
   HashType hash;    // Standard zobrist Hash
   HashType hash_p;  // Zobrist Pawn/King Hash
   HashType hash_pm; // Mirrored Zobrist Pawn/King Hash
-
-  int32_t fifty_move_count;
+  //Squares and pieces added or removed since the attack maps were last updated.
+  mutable BitBoard changed_squares;
+  size_t num_made_moves;
+  int16_t fifty_move_count;
+  //Positions before the last null move cannot be repeated by real moves.
+  int16_t plies_since_null;
+  int16_t phase;
+  mutable uint16_t changed_pieces;
+  //4 bits are set representing white and black, queen- and kingside castling
+  uint8_t castling_rights;
+  uint8_t en_passant;
+  uint8_t turn;
+  int8_t piece_counts[kNumPlayers][kNumPieceTypes - 1];
+  uint8_t pieces[kBoardLength*kBoardLength];
+  //State before each made move. Entries are reused, the stack only grows when a
+  //new maximum number of made moves is reached.
+  std::vector<PlyState> state_stack;
+  //Squares attacked by the piece on each square and their union by color and piece type.
+  mutable BitBoard attacks[kNumPlayers][kNumPieceTypes - 1];
+  mutable BitBoard square_attacks[kBoardLength*kBoardLength];
 };
 
 #endif /* BOARD_H_ */
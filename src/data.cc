@@ -44,7 +44,7 @@ std::vector<Game> LoadGames(size_t max_games, std::string game_file) {
     Game game;
     for (size_t i = 0; i < tokens.size()-1; i++) {
       Move move = parse::StringToMove(tokens[i]);
-      std::vector<Move> moves = game.board.GetMoves<kNonQuiescent>();
+      MoveList moves = game.board.GetMoves<kNonQuiescent>();
       for (size_t j = 0; j < moves.size(); j++) {
         if (GetMoveSource(moves[j]) == GetMoveSource(move)
             && GetMoveDestination(moves[j]) == GetMoveDestination(move)
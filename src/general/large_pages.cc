@@ -0,0 +1,287 @@
+/*
+ *  Winter is a UCI chess engine.
+ *
+ *  Copyright (C) 2016 Jonas Kuratli, Jonathan Maurer, Jonathan Rosenthal
+ *  Copyright (C) 2017-2018 Jonathan Rosenthal
+ *
+ *  Winter is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Winter is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * large_pages.cc
+ *
+ *  Created on: Oct 16, 2026
+ */
+
+#include "large_pages.h"
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+constexpr size_t kAlignment = 64;
+constexpr size_t kSmallPageSize = 4096;
+constexpr size_t kHugePageSize = 2 << 20;
+constexpr size_t kGiantPageSize = 1 << 30;
+
+size_t RoundUp(size_t bytes, size_t multiple) {
+  return ((bytes + multiple - 1) / multiple) * multiple;
+}
+
+#ifdef __linux__
+//Explicit huge pages from the pool reserved in /proc/sys/vm/nr_hugepages or the
+//1GB equivalent. Hugetlb mappings are reserved on mmap, so failure shows up here.
+bool MapExplicit(large_pages::Allocation &allocation, size_t bytes, size_t page_size,
+                 int log_page_size) {
+#if defined(MAP_HUGETLB) && defined(MAP_HUGE_SHIFT)
+  const size_t length = RoundUp(bytes, page_size);
+  void *memory = mmap(nullptr, length, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (log_page_size << MAP_HUGE_SHIFT),
+                      -1, 0);
+  if (memory == MAP_FAILED) {
+    return false;
+  }
+  allocation.memory = allocation.base = memory;
+  allocation.bytes = length;
+  allocation.page_size = page_size;
+  allocation.mapped = true;
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool TransparentHugePagesEnabled() {
+  std::ifstream file("/sys/kernel/mm/transparent_hugepage/enabled");
+  std::string line;
+  return std::getline(file, line) && line.find("[never]") == std::string::npos;
+}
+
+bool ShmemHugePagesEnabled() {
+  std::ifstream file("/sys/kernel/mm/transparent_hugepage/shmem_enabled");
+  std::string line;
+  return std::getline(file, line) && (line.find("[always]") != std::string::npos
+      || line.find("[within_size]") != std::string::npos
+      || line.find("[advise]") != std::string::npos);
+}
+
+//Regular mapping aligned to the huge page size, so the kernel is able to back it with
+//transparent huge pages. The unaligned head and tail are returned right away.
+bool MapTransparent(large_pages::Allocation &allocation, size_t bytes) {
+  const size_t length = RoundUp(bytes, kSmallPageSize);
+  const size_t alignment = length >= kHugePageSize ? kHugePageSize : kSmallPageSize;
+  const size_t padded_length = length + alignment - kSmallPageSize;
+  void *memory = mmap(nullptr, padded_length, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (memory == MAP_FAILED) {
+    return false;
+  }
+  const uintptr_t start = reinterpret_cast<uintptr_t>(memory);
+  const uintptr_t aligned_start = RoundUp(start, alignment);
+  if (aligned_start > start) {
+    munmap(memory, aligned_start - start);
+  }
+  const size_t tail = padded_length - (aligned_start - start) - length;
+  if (tail > 0) {
+    munmap(reinterpret_cast<void*>(aligned_start + length), tail);
+  }
+  allocation.memory = allocation.base = reinterpret_cast<void*>(aligned_start);
+  allocation.bytes = length;
+  allocation.page_size = kSmallPageSize;
+  allocation.mapped = true;
+#ifdef MADV_HUGEPAGE
+  if (alignment == kHugePageSize && TransparentHugePagesEnabled()
+      && madvise(allocation.memory, length, MADV_HUGEPAGE) == 0) {
+    allocation.page_size = kHugePageSize;
+    allocation.transparent = true;
+  }
+#endif
+  return true;
+}
+#endif
+
+}
+
+namespace large_pages {
+
+Allocation Allocate(size_t bytes) {
+  Allocation allocation;
+  if (bytes == 0) {
+    bytes = 1;
+  }
+#ifdef __linux__
+  if (bytes >= kGiantPageSize && MapExplicit(allocation, bytes, kGiantPageSize, 30)) {
+    return allocation;
+  }
+  if (bytes >= kHugePageSize && MapExplicit(allocation, bytes, kHugePageSize, 21)) {
+    return allocation;
+  }
+  if (MapTransparent(allocation, bytes)) {
+    return allocation;
+  }
+#endif
+  //Portable fallback, calloc does not guarantee cache line alignment.
+  void *base = std::calloc(bytes + kAlignment, 1);
+  if (base == nullptr) {
+    return allocation;
+  }
+  allocation.base = base;
+  allocation.memory = reinterpret_cast<void*>(
+      RoundUp(reinterpret_cast<uintptr_t>(base), kAlignment));
+  allocation.bytes = bytes + kAlignment;
+  allocation.page_size = kSmallPageSize;
+  return allocation;
+}
+
+Allocation MapFile(const std::string &file_name, size_t offset, size_t bytes) {
+  Allocation allocation;
+#ifdef __linux__
+  const int file = open(file_name.c_str(), O_RDONLY);
+  if (file < 0) {
+    return allocation;
+  }
+  void *memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, offset);
+  close(file);
+  if (memory == MAP_FAILED) {
+    return allocation;
+  }
+  allocation.memory = allocation.base = memory;
+  allocation.bytes = bytes;
+  allocation.page_size = kSmallPageSize;
+  allocation.mapped = true;
+#else
+  //Without mmap the section is read into regular memory.
+  std::ifstream file(file_name, std::ios::binary);
+  if (!file.seekg(offset)) {
+    return allocation;
+  }
+  allocation = Allocate(bytes);
+  if (allocation.memory != nullptr
+      && !file.read(static_cast<char*>(allocation.memory), bytes)) {
+    Free(allocation);
+  }
+#endif
+  return allocation;
+}
+
+Allocation MapShared(const std::string &name, size_t bytes) {
+  Allocation allocation;
+#ifdef __linux__
+  //Attaching and detaching are serialized with an exclusive lock on the object. The last
+  //process to detach unlinks the name while holding it, so an object which is unlinked
+  //by the time we get the lock is stale and we retry with a fresh one.
+  int file = -1;
+  struct stat status;
+  while (true) {
+    file = shm_open(name.c_str(), O_RDWR | O_CREAT, 0600);
+    if (file < 0) {
+      return allocation;
+    }
+    if (flock(file, LOCK_EX) != 0 || fstat(file, &status) != 0) {
+      close(file);
+      return allocation;
+    }
+    if (status.st_nlink > 0) {
+      break;
+    }
+    close(file);
+  }
+  //The object starts with a header holding the number of processes using it. The header
+  //fills a whole huge page for big objects, so the data stays huge page aligned.
+  const size_t header_size = bytes >= kHugePageSize ? kHugePageSize : kSmallPageSize;
+  const size_t length = header_size + RoundUp(bytes, header_size);
+  bool valid_size = true;
+  if (status.st_size == 0) {
+    valid_size = ftruncate(file, length) == 0;
+  }
+  else {
+    valid_size = static_cast<size_t>(status.st_size) == length;
+  }
+  void *memory = valid_size ? mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0)
+                            : MAP_FAILED;
+  if (memory == MAP_FAILED) {
+    close(file);
+    return allocation;
+  }
+  static_cast<std::atomic<uint32_t>*>(memory)->fetch_add(1);
+  flock(file, LOCK_UN);
+  allocation.shared_file = file;
+  allocation.base = memory;
+  allocation.memory = static_cast<char*>(memory) + header_size;
+  allocation.bytes = length;
+  allocation.page_size = kSmallPageSize;
+  allocation.mapped = true;
+  allocation.shared_name = name;
+#ifdef MADV_HUGEPAGE
+  if (header_size == kHugePageSize && ShmemHugePagesEnabled()
+      && madvise(memory, length, MADV_HUGEPAGE) == 0) {
+    allocation.transparent = true;
+    allocation.page_size = kHugePageSize;
+  }
+#endif
+#endif
+  return allocation;
+}
+
+void Free(Allocation &allocation) {
+  if (allocation.base != nullptr) {
+#ifdef __linux__
+    if (allocation.shared_file >= 0) {
+      flock(allocation.shared_file, LOCK_EX);
+      if (static_cast<std::atomic<uint32_t>*>(allocation.base)->fetch_sub(1) == 1) {
+        shm_unlink(allocation.shared_name.c_str());
+      }
+      flock(allocation.shared_file, LOCK_UN);
+      close(allocation.shared_file);
+    }
+    if (allocation.mapped) {
+      munmap(allocation.base, allocation.bytes);
+    }
+    else {
+      std::free(allocation.base);
+    }
+#else
+    std::free(allocation.base);
+#endif
+  }
+  allocation = Allocation();
+}
+
+std::string Describe(const Allocation &allocation) {
+  std::string size;
+  if (allocation.page_size >= kGiantPageSize) {
+    size = std::to_string(allocation.page_size >> 30) + "GB";
+  }
+  else if (allocation.page_size >= (1 << 20)) {
+    size = std::to_string(allocation.page_size >> 20) + "MB";
+  }
+  else {
+    size = std::to_string(allocation.page_size >> 10) + "KB";
+  }
+  if (allocation.transparent) {
+    return size + " transparent huge pages";
+  }
+  return size + " pages";
+}
+
+}
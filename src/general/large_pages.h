@@ -0,0 +1,116 @@
+/*
+ *  Winter is a UCI chess engine.
+ *
+ *  Copyright (C) 2016 Jonas Kuratli, Jonathan Maurer, Jonathan Rosenthal
+ *  Copyright (C) 2017-2018 Jonathan Rosenthal
+ *
+ *  Winter is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Winter is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * large_pages.h
+ *
+ *  Created on: Oct 16, 2026
+ */
+
+#ifndef GENERAL_LARGE_PAGES_H_
+#define GENERAL_LARGE_PAGES_H_
+
+#include <cstddef>
+#include <new>
+#include <string>
+#include <type_traits>
+
+/**
+ * Allocation of big tables on huge pages in order to reduce TLB misses. Explicit 1GB
+ * and 2MB pages are tried first, which only succeeds if the OS has reserved them.
+ * Otherwise memory is aligned to 2MB and transparent huge pages are requested. If
+ * neither is available regular pages are used.
+ */
+namespace large_pages {
+
+struct Allocation {
+  void *memory = nullptr;
+  //Start and length of the underlying mapping, which may be larger than requested.
+  void *base = nullptr;
+  size_t bytes = 0;
+  size_t page_size = 0;
+  bool transparent = false;
+  bool mapped = false;
+  //Name of the POSIX shared memory object if the memory comes from MapShared.
+  std::string shared_name;
+  //Descriptor of that object, kept open to lock it when detaching.
+  int shared_file = -1;
+};
+
+//Returns zeroed memory of at least the requested size, aligned to at least 64 bytes.
+//memory is nullptr if the allocation failed.
+Allocation Allocate(size_t bytes);
+//Maps bytes of the file starting at offset, which must be a multiple of the page size.
+//The mapping is private, so the file is read lazily and writes never reach it.
+//memory is nullptr if the file could not be mapped.
+Allocation MapFile(const std::string &file_name, size_t offset, size_t bytes);
+//Maps the named POSIX shared memory object, creating it zeroed if it does not exist yet.
+//Processes mapping the same name share the memory. The object is removed once the last
+//process frees its mapping. memory is nullptr if the object could not be mapped, eg if
+//it exists with a different size.
+Allocation MapShared(const std::string &name, size_t bytes);
+void Free(Allocation &allocation);
+//Human readable page size, eg "2MB transparent huge pages".
+std::string Describe(const Allocation &allocation);
+
+//Fixed size array of trivial elements backed by Allocate. In contrast to std::vector,
+//resizing does not preserve the contents. All elements are zero afterwards.
+template<typename T>
+class Array {
+  static_assert(std::is_trivially_copyable<T>::value, "Elements are zero initialized.");
+public:
+  Array() : count(0) {}
+  explicit Array(size_t size) : count(0) { resize(size); }
+  Array(const Array&) = delete;
+  Array& operator=(const Array&) = delete;
+  ~Array() { Free(allocation); }
+
+  void resize(size_t size) {
+    Free(allocation);
+    count = 0;
+    allocation = Allocate(size * sizeof(T));
+    if (allocation.memory == nullptr) {
+      throw std::bad_alloc();
+    }
+    count = size;
+  }
+
+  //Takes ownership of memory obtained from MapFile holding size elements.
+  void adopt(Allocation &&new_allocation, size_t size) {
+    Free(allocation);
+    allocation = new_allocation;
+    new_allocation = Allocation();
+    count = size;
+  }
+
+  T& operator[](size_t idx) { return data()[idx]; }
+  const T& operator[](size_t idx) const { return data()[idx]; }
+  T* data() { return static_cast<T*>(allocation.memory); }
+  const T* data() const { return static_cast<const T*>(allocation.memory); }
+  size_t size() const { return count; }
+  const Allocation &get_allocation() const { return allocation; }
+
+private:
+  Allocation allocation;
+  size_t count;
+};
+
+}
+
+#endif /* GENERAL_LARGE_PAGES_H_ */
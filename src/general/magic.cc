@@ -29,10 +29,8 @@
 #include "types.h"
 #include <cassert>
 #include <array>
-
-#if defined(__BMI2__) and defined(PEXT)
+#include <cpuid.h>
 #include <immintrin.h>
-#endif
 
 
 namespace {
@@ -75,7 +73,6 @@ constexpr std::array<BitBoard, 64> rookMask = {
     0x6e10101010101000L, 0x5e20202020202000L, 0x3e40404040404000L, 0x7e80808080808000L
 };
 
-#if !defined(__BMI2__) or !defined(PEXT)
 const BitBoard bishopMagicNumber[] = {
     0x10020800408200L, 0x8080800802000L, 0x4040082000000L, 0x4040080000000L, 0x2021000000000L, 0x901008000000L, 0x880808040000L, 0x1002082201000L,
     0x81001020400L, 0x80204040020L, 0x40802004000L, 0x40400800000L, 0x20210000000L, 0x10402400000L, 0x8084104000L, 0x20082011000L,
@@ -97,7 +94,6 @@ const BitBoard rookMagicNumber[] = {
     0x800040002080L, 0x804000200080L, 0x801000200080L, 0x80010008080L, 0x40080080080L, 0x800200040080L, 0x1000200040100L, 0x800041000080L,
     0x201041008001L, 0x801021004001L, 0x410020000811L, 0x100004210009L, 0x2001020040802L, 0x1000400080201L, 0x1000200008401L, 0x1000080220041L,
 };
-#endif
 
 constexpr std::array<char, 64> bishopShiftBits = {
     6, 5, 5, 5, 5, 5, 5, 6,
@@ -121,6 +117,65 @@ constexpr std::array<char, 64> rookShiftBits = {
     12, 11, 11, 11, 11, 11, 11, 12
 };
 
+// Builds without -mbmi2 emit the instruction through inline assembly, so PEXT lookups
+// are still inlined into their callers. It is only executed if DetectFastPext chose it.
+inline BitBoard Pext(const BitBoard bb, const BitBoard mask) {
+#if defined(__BMI2__)
+  return _pext_u64(bb, mask);
+#else
+  BitBoard result;
+  asm("pextq %2, %1, %0" : "=r"(result) : "r"(bb), "rm"(mask));
+  return result;
+#endif
+}
+
+// PEXT is only used if the CPU supports BMI2 and implements it in hardware. AMD
+// processors before Zen 3 (family 19h) microcode it, which is slower than the
+// magic multiplication.
+bool DetectFastPext() {
+  __builtin_cpu_init();
+  if (!__builtin_cpu_supports("bmi2")) {
+    return false;
+  }
+  if (__builtin_cpu_is("amd")) {
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+      return false;
+    }
+    unsigned int family = (eax >> 8) & 0xF;
+    if (family == 0xF) {
+      family += (eax >> 20) & 0xFF;
+    }
+    return family >= 0x19;
+  }
+  return true;
+}
+
+// Selected once at startup, the slider tables below are indexed accordingly.
+struct SliderIndexingChoice {
+  SliderIndexingChoice() :
+    indexing(DetectFastPext() ? magic::SliderIndexing::kPext : magic::SliderIndexing::kMagic) {}
+  const magic::SliderIndexing indexing;
+};
+const SliderIndexingChoice slider_indexing __attribute__((init_priority(101)));
+
+// Attack maps of each square are stored in a variable sized slice of one packed
+// table, as a square needs only 2^(relevant occupancy bits) entries.
+struct SliderMagic {
+  BitBoard *attacks;
+  BitBoard mask;
+  BitBoard magic;
+  int shift;
+};
+
+template<magic::SliderIndexing indexing>
+inline size_t GetSliderIndex(const SliderMagic &slider, const BitBoard all_pieces) {
+  if (indexing == magic::SliderIndexing::kPext) {
+    return Pext(all_pieces, slider.mask);
+  }
+  return ((all_pieces & slider.mask) * slider.magic) >> slider.shift;
+}
+
 constexpr std::array<BitBoard, 64> knightAttackMap = {
     0x20400,            0x50800,            0xa1100,            0x142200,
     0x284400,           0x508800,           0xa01000,           0x402000,
@@ -218,70 +273,43 @@ BitBoard getConfigurationOfEmpty(BitBoard mask, int configuration) {
     return ~pieceConfiguration;
 }
 
-const std::array<std::array<BitBoard, (1L << 9)>, 64> generateBishopAttackMaps() {
-    std::array<std::array<BitBoard, (1L << 9)>, 64> bishopMagic;
-    //For each square:
-    for (int squareIndex = 0; squareIndex < 64; squareIndex++) {
-        BitBoard origin = GetSquareBitBoard(squareIndex);
-        //get mask bits
-        BitBoard maskBits = bishopMask[squareIndex];
-#if !defined(__BMI2__) or !defined(PEXT)
-        //get magic number
-        BitBoard magic = bishopMagicNumber[squareIndex];
-#endif
-        //For each possible configuration of masked bits
-        for (int configuration = 0; configuration < (0x1L << bishopShiftBits[squareIndex]); configuration++) {
-            BitBoard empty = getConfigurationOfEmpty(maskBits, configuration);
-            //Calculate attack map
-            BitBoard attackMap = bitops::NE(bitops::FillNorthEast(origin, empty)) |
-                    bitops::SE(bitops::FillSouthEast(origin, empty)) |
-                    bitops::SW(bitops::FillSouthWest(origin, empty)) |
-                    bitops::NW(bitops::FillNorthWest(origin, empty));
-            //Calculate Index via multiplication of magic number
-            //Save calculated attack map to calculated index for square index of piece
-#if defined(__BMI2__) and defined(PEXT)
-              bishopMagic[squareIndex][_pext_u64(~empty, maskBits)] = attackMap;
-#else
-              bishopMagic[squareIndex][(int) ((~empty * magic) >> (64 - bishopShiftBits[squareIndex]))] = attackMap;
-#endif
-        //end
-        }
-    //end
-    }
-    return bishopMagic;
+BitBoard GetSliderAttacks(const PieceType piece_type, const BitBoard origin, const BitBoard empty) {
+  if (piece_type == kBishop) {
+    return bitops::NE(bitops::FillNorthEast(origin, empty)) |
+           bitops::SE(bitops::FillSouthEast(origin, empty)) |
+           bitops::SW(bitops::FillSouthWest(origin, empty)) |
+           bitops::NW(bitops::FillNorthWest(origin, empty));
+  }
+  return bitops::N(bitops::FillNorth(origin, empty)) |
+         bitops::E(bitops::FillEast(origin, empty)) |
+         bitops::S(bitops::FillSouth(origin, empty)) |
+         bitops::W(bitops::FillWest(origin, empty));
 }
 
-const std::array<std::array<BitBoard, (1L << 12)>, 64> generateRookAttackMaps() {
-    std::array<std::array<BitBoard, (1L << 12)>, 64> rookMagic;
-    //For each square:
-    for (int squareIndex = 0; squareIndex < 64; squareIndex++) {
-        BitBoard origin = GetSquareBitBoard(squareIndex);
-        //get mask bits
-        BitBoard maskBits = rookMask[squareIndex];
-#if !defined(__BMI2__) or !defined(PEXT)
-        //get magic number
-        BitBoard magic = rookMagicNumber[squareIndex];
-#endif
-        //For each possible configuration of masked bits
-        for (int configuration = 0; configuration < (0x1L << rookShiftBits[squareIndex]); configuration++) {
-            BitBoard empty = getConfigurationOfEmpty(maskBits, configuration);
-            //Calculate attack map
-            BitBoard attackMap = bitops::N(bitops::FillNorth(origin, empty)) |
-                bitops::E(bitops::FillEast(origin, empty)) |
-                bitops::S(bitops::FillSouth(origin, empty)) |
-                bitops::W(bitops::FillWest(origin, empty));
-            //Calculate Index via multiplication of magic number
-            //Save calculated attack map to calculated index for square index of piece
-#if defined(__BMI2__) and defined(PEXT)
-              rookMagic[squareIndex][_pext_u64(~empty, maskBits)] = attackMap;
-#else
-              rookMagic[squareIndex][(int) ((~empty * magic) >> (64 - rookShiftBits[squareIndex]))] = attackMap;
-#endif
-        //end
-        }
-    //end
+// Fills consecutive slices of table, one per square, and returns the lookup
+// information of each square.
+const std::array<SliderMagic, 64> initSliderMagics(const PieceType piece_type,
+                                                   BitBoard *table) {
+  std::array<SliderMagic, 64> sliders;
+  for (Square square = 0; square < 64; square++) {
+    const int bits = piece_type == kBishop ? bishopShiftBits[square] : rookShiftBits[square];
+    SliderMagic &slider = sliders[square];
+    slider.attacks = table;
+    slider.mask = piece_type == kBishop ? bishopMask[square] : rookMask[square];
+    slider.magic = piece_type == kBishop ? bishopMagicNumber[square] : rookMagicNumber[square];
+    slider.shift = 64 - bits;
+    //For each possible configuration of masked bits save the attack map at its index.
+    for (int configuration = 0; configuration < (0x1 << bits); configuration++) {
+      BitBoard empty = getConfigurationOfEmpty(slider.mask, configuration);
+      const size_t index = slider_indexing.indexing == magic::SliderIndexing::kPext ?
+          GetSliderIndex<magic::SliderIndexing::kPext>(slider, ~empty)
+        : GetSliderIndex<magic::SliderIndexing::kMagic>(slider, ~empty);
+      slider.attacks[index] =
+          GetSliderAttacks(piece_type, GetSquareBitBoard(square), empty);
     }
-    return rookMagic;
+    table += 0x1 << bits;
+  }
+  return sliders;
 }
 
 const std::array<BitBoard, 64> initKingSafetyMap() {
@@ -309,6 +337,35 @@ const std::array<BitBoard, 64> initKingSafetyMap() {
   return king_map;
 }
 
+// For aligned squares a and b, line_map[a][b] contains the full line through both
+// squares and between_map[a][b] the squares strictly between them.
+const std::array<std::array<BitBoard, 64>, 64> initLineMap(const bool between) {
+  std::array<std::array<BitBoard, 64>, 64> line_map;
+  for (Square a = 0; a < 64; a++) {
+    for (Square b = 0; b < 64; b++) {
+      line_map[a][b] = 0;
+      const int dx = GetSquareX(b) - GetSquareX(a);
+      const int dy = GetSquareY(b) - GetSquareY(a);
+      if (a == b || (dx != 0 && dy != 0 && std::abs(dx) != std::abs(dy))) {
+        continue;
+      }
+      for (Square c = 0; c < 64; c++) {
+        const int cx = GetSquareX(c) - GetSquareX(a);
+        const int cy = GetSquareY(c) - GetSquareY(a);
+        if (cx * dy != cy * dx) {
+          continue;
+        }
+        const bool towards_b = cx * dx + cy * dy > 0;
+        const bool before_b = std::max(std::abs(cx), std::abs(cy)) < std::max(std::abs(dx), std::abs(dy));
+        if (!between || (towards_b && before_b)) {
+          line_map[a][b] |= GetSquareBitBoard(c);
+        }
+      }
+    }
+  }
+  return line_map;
+}
+
 const std::array<BitBoard, 64> initFileMap() {
   std::array<BitBoard, 64> file_map;
   for (Square a = 0; a < 64; a++) {
@@ -321,36 +378,46 @@ const std::array<BitBoard, 64> initFileMap() {
 }
 
 const std::array<BitBoard, 64> file_map = initFileMap();
+const std::array<std::array<BitBoard, 64>, 64> line_map = initLineMap(false);
+const std::array<std::array<BitBoard, 64>, 64> between_map = initLineMap(true);
 const std::array<std::array<int, 64>, 64> distance_map = initDistMap();
 const std::array<BitBoard, 64> kingSafetyMap = initKingSafetyMap();
 const std::array<std::array<BitBoard, 64>, 64> attackVectorMap = generateAttackVectorMaps();
-const std::array<std::array<BitBoard, (1L << 9)>, 64> bishopMagic = generateBishopAttackMaps();
-const std::array<std::array<BitBoard, (1L << 12)>, 64> rookMagic = generateRookAttackMaps();
+// Sum of 2^bits over all squares, 41KB for bishops and 800KB for rooks.
+constexpr size_t kBishopTableSize = 5248;
+constexpr size_t kRookTableSize = 102400;
+std::array<BitBoard, kBishopTableSize + kRookTableSize> slider_attacks;
+// The cuckoo table in board.cc is built from slider attacks during static
+// initialization, so these tables are initialized first.
+const std::array<SliderMagic, 64> bishopMagic __attribute__((init_priority(101))) =
+    initSliderMagics(kBishop, slider_attacks.data());
+const std::array<SliderMagic, 64> rookMagic __attribute__((init_priority(101))) =
+    initSliderMagics(kRook, slider_attacks.data() + kBishopTableSize);
 
 }
 
 namespace magic{
 
+SliderIndexing GetSliderIndexing() {
+  return slider_indexing.indexing;
+}
+
 template<> BitBoard GetAttackMap<kKnight>(const int &index, BitBoard allPieces) {
     return knightAttackMap[index];
 }
 
 template<> BitBoard GetAttackMap<kBishop>(const int &index, BitBoard allPieces) {
-#if defined(__BMI2__) and defined(PEXT)
-    return bishopMagic[index][_pext_u64(allPieces, bishopMask[index])];
-#else
-  allPieces &= bishopMask[index];
-  return bishopMagic[index][(int) ((allPieces * bishopMagicNumber[index]) >> (64 - bishopShiftBits[index]))];
-#endif
+    if (slider_indexing.indexing == SliderIndexing::kPext) {
+      return GetAttackMap<kBishop, SliderIndexing::kPext>(index, allPieces);
+    }
+    return GetAttackMap<kBishop, SliderIndexing::kMagic>(index, allPieces);
 }
 
 template<> BitBoard GetAttackMap<kRook>(const int &index, BitBoard allPieces) {
-#if defined(__BMI2__) and defined(PEXT)
-    return rookMagic[index][_pext_u64(allPieces, rookMask[index])];
-#else
-    allPieces &= rookMask[index];
-    return rookMagic[index][(int) ((allPieces * rookMagicNumber[index]) >> (64 - rookShiftBits[index]))];
-#endif
+    if (slider_indexing.indexing == SliderIndexing::kPext) {
+      return GetAttackMap<kRook, SliderIndexing::kPext>(index, allPieces);
+    }
+    return GetAttackMap<kRook, SliderIndexing::kMagic>(index, allPieces);
 }
 
 template<> BitBoard GetAttackMap<kQueen>(const int &index, BitBoard allPieces) {
@@ -361,6 +428,42 @@ template<> BitBoard GetAttackMap<kKing>(const int &index, BitBoard allPieces) {
     return kingAttackMap[index];
 }
 
+template<PieceType pt, SliderIndexing indexing>
+BitBoard GetAttackMap(const int &index, BitBoard all_pieces) {
+  switch (pt) {
+  case kKnight: return knightAttackMap[index];
+  case kBishop: return bishopMagic[index].attacks[GetSliderIndex<indexing>(bishopMagic[index], all_pieces)];
+  case kRook: return rookMagic[index].attacks[GetSliderIndex<indexing>(rookMagic[index], all_pieces)];
+  case kQueen: return GetAttackMap<kBishop, indexing>(index, all_pieces)
+                    | GetAttackMap<kRook, indexing>(index, all_pieces);
+  default: return kingAttackMap[index];
+  }
+}
+
+template<SliderIndexing indexing>
+BitBoard GetAttackMap(PieceType piece_type, Square square, BitBoard all_pieces) {
+  switch (piece_type) {
+  case kQueen: return GetAttackMap<kQueen, indexing>(square, all_pieces);
+  case kRook: return GetAttackMap<kRook, indexing>(square, all_pieces);
+  case kBishop: return GetAttackMap<kBishop, indexing>(square, all_pieces);
+  case kKnight: return GetAttackMap<kKnight, indexing>(square, all_pieces);
+  default: return 0;
+  }
+}
+
+template BitBoard GetAttackMap<kKnight, SliderIndexing::kMagic>(const int &, BitBoard);
+template BitBoard GetAttackMap<kBishop, SliderIndexing::kMagic>(const int &, BitBoard);
+template BitBoard GetAttackMap<kRook, SliderIndexing::kMagic>(const int &, BitBoard);
+template BitBoard GetAttackMap<kQueen, SliderIndexing::kMagic>(const int &, BitBoard);
+template BitBoard GetAttackMap<kKing, SliderIndexing::kMagic>(const int &, BitBoard);
+template BitBoard GetAttackMap<kKnight, SliderIndexing::kPext>(const int &, BitBoard);
+template BitBoard GetAttackMap<kBishop, SliderIndexing::kPext>(const int &, BitBoard);
+template BitBoard GetAttackMap<kRook, SliderIndexing::kPext>(const int &, BitBoard);
+template BitBoard GetAttackMap<kQueen, SliderIndexing::kPext>(const int &, BitBoard);
+template BitBoard GetAttackMap<kKing, SliderIndexing::kPext>(const int &, BitBoard);
+template BitBoard GetAttackMap<SliderIndexing::kMagic>(PieceType, Square, BitBoard);
+template BitBoard GetAttackMap<SliderIndexing::kPext>(PieceType, Square, BitBoard);
+
 BitBoard getAttackVectors(BitBoard src, BitBoard des) {
     BitBoard res = 0;
     Square i = bitops::NumberOfTrailingZeros(src);
@@ -372,13 +475,10 @@ BitBoard getAttackVectors(BitBoard src, BitBoard des) {
 }
 
 BitBoard GetAttackMap(PieceType piece_type, Square square, BitBoard all_pieces) {
-  switch (piece_type) {
-  case kQueen: return GetAttackMap<kQueen>(square, all_pieces);
-  case kRook: return GetAttackMap<kRook>(square, all_pieces);
-  case kBishop: return GetAttackMap<kBishop>(square, all_pieces);
-  case kKnight: return GetAttackMap<kKnight>(square, all_pieces);
-  default: return 0;
+  if (slider_indexing.indexing == SliderIndexing::kPext) {
+    return GetAttackMap<SliderIndexing::kPext>(piece_type, square, all_pieces);
   }
+  return GetAttackMap<SliderIndexing::kMagic>(piece_type, square, all_pieces);
 }
 
 int GetSquareDistance(const Square a, const Square b) {
@@ -393,4 +493,12 @@ BitBoard GetSquareFile(const Square square) {
   return file_map[square];
 }
 
+BitBoard GetLine(const Square a, const Square b) {
+  return line_map[a][b];
+}
+
+BitBoard GetSquaresBetween(const Square a, const Square b) {
+  return between_map[a][b];
+}
+
 }
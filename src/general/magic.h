@@ -31,13 +31,32 @@
 
 namespace magic {
 
+// How slider attack tables are indexed. The scheme is selected once at startup.
+// Hot code is instantiated for both schemes and picks an instantiation once per
+// call into it, so individual lookups do not test the scheme.
+enum class SliderIndexing {
+  kMagic, kPext
+};
+SliderIndexing GetSliderIndexing();
+
+// These lookups test the indexing scheme on each call and are meant for code
+// outside of search and evaluation.
 template<PieceType pt>
 BitBoard GetAttackMap(const int &index, BitBoard AllPieces);
 BitBoard GetAttackVectors(BitBoard src, BitBoard des);
 BitBoard GetAttackMap(PieceType piece_type, Square square, BitBoard all_pieces);
+
+template<PieceType pt, SliderIndexing indexing>
+BitBoard GetAttackMap(const int &index, BitBoard all_pieces);
+template<SliderIndexing indexing>
+BitBoard GetAttackMap(PieceType piece_type, Square square, BitBoard all_pieces);
 int GetSquareDistance(const Square a, const Square b);
 BitBoard GetKingArea(const Square square);
 BitBoard GetSquareFile(const Square square);
+// Full line through two aligned squares, or 0 if they are not aligned.
+BitBoard GetLine(const Square a, const Square b);
+// Squares strictly between two aligned squares, or 0 if they are not aligned.
+BitBoard GetSquaresBetween(const Square a, const Square b);
 
 }
 
@@ -0,0 +1,158 @@
+/*
+ *  Winter is a UCI chess engine.
+ *
+ *  Copyright (C) 2016 Jonas Kuratli, Jonathan Maurer, Jonathan Rosenthal
+ *  Copyright (C) 2017-2018 Jonathan Rosenthal
+ *
+ *  Winter is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Winter is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * numa.cc
+ *
+ *  Created on: Oct 16, 2026
+ */
+
+#include "numa.h"
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+namespace {
+
+struct Node {
+  int id;
+  std::vector<int> cpus;
+};
+
+bool enabled = false;
+
+//Parses sysfs lists such as "0-15,32-47".
+std::vector<int> ParseList(const std::string &list) {
+  std::vector<int> values;
+  size_t pos = 0;
+  while (pos < list.size()) {
+    size_t end = list.find(',', pos);
+    if (end == std::string::npos) {
+      end = list.size();
+    }
+    const std::string range = list.substr(pos, end - pos);
+    const size_t dash = range.find('-');
+    if (!range.empty()) {
+      const int first = std::stoi(range.substr(0, dash));
+      const int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+      for (int i = first; i <= last; ++i) {
+        values.push_back(i);
+      }
+    }
+    pos = end + 1;
+  }
+  return values;
+}
+
+std::string ReadLine(const std::string &file_name) {
+  std::ifstream file(file_name);
+  std::string line;
+  std::getline(file, line);
+  return line;
+}
+
+std::vector<Node> ReadTopology() {
+  std::vector<Node> nodes;
+#ifdef __linux__
+  const std::string base = "/sys/devices/system/node/";
+  for (const int id : ParseList(ReadLine(base + "online"))) {
+    Node node { id, ParseList(ReadLine(base + "node" + std::to_string(id) + "/cpulist")) };
+    if (!node.cpus.empty()) {
+      nodes.push_back(node);
+    }
+  }
+#endif
+  return nodes;
+}
+
+const std::vector<Node> &GetNodes() {
+  static const std::vector<Node> nodes = ReadTopology();
+  return nodes;
+}
+
+}
+
+namespace numa {
+
+void SetEnabled(bool enabled_) {
+  enabled = enabled_;
+}
+
+bool IsEnabled() {
+  return enabled;
+}
+
+size_t GetNodeCount() {
+  return std::max(GetNodes().size(), static_cast<size_t>(1));
+}
+
+bool BindThisThread(size_t idx) {
+#ifdef __linux__
+  const std::vector<Node> &nodes = GetNodes();
+  if (nodes.empty()) {
+    return false;
+  }
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  for (const int cpu : nodes[idx % nodes.size()].cpus) {
+    CPU_SET(cpu, &cpu_set);
+  }
+  return sched_setaffinity(0, sizeof(cpu_set), &cpu_set) == 0;
+#else
+  return false;
+#endif
+}
+
+void Interleave(void *address, size_t bytes) {
+#if defined(__linux__) && defined(SYS_mbind)
+  if (GetNodes().size() < 2) {
+    return;
+  }
+  //Values from linux/mempolicy.h, which is not guaranteed to be installed.
+  constexpr int kMpolInterleave = 3;
+  constexpr unsigned kMpolMfMove = 1 << 1;
+  constexpr size_t kBitsPerWord = 8 * sizeof(unsigned long);
+  std::vector<unsigned long> mask(1);
+  for (const Node &node : GetNodes()) {
+    const size_t word = node.id / kBitsPerWord;
+    if (word >= mask.size()) {
+      mask.resize(word + 1);
+    }
+    mask[word] |= 1UL << (node.id % kBitsPerWord);
+  }
+  //mbind requires a page aligned start address.
+  const size_t page_size = sysconf(_SC_PAGESIZE);
+  const size_t start = reinterpret_cast<size_t>(address);
+  const size_t aligned_start = (start + page_size - 1) & ~(page_size - 1);
+  if (aligned_start >= start + bytes) {
+    return;
+  }
+  syscall(SYS_mbind, aligned_start, start + bytes - aligned_start, kMpolInterleave,
+          mask.data(), mask.size() * kBitsPerWord + 1, kMpolMfMove);
+#endif
+}
+
+}
@@ -0,0 +1,55 @@
+/*
+ *  Winter is a UCI chess engine.
+ *
+ *  Copyright (C) 2016 Jonas Kuratli, Jonathan Maurer, Jonathan Rosenthal
+ *  Copyright (C) 2017-2018 Jonathan Rosenthal
+ *
+ *  Winter is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Winter is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * numa.h
+ *
+ *  Created on: Oct 16, 2026
+ */
+
+#ifndef GENERAL_NUMA_H_
+#define GENERAL_NUMA_H_
+
+#include <cstddef>
+
+/**
+ * Minimal NUMA support based on the Linux sysfs topology and raw syscalls, so no
+ * libnuma is required. On other platforms or if the topology cannot be read the
+ * machine is treated as a single node and binding requests fail gracefully.
+ */
+namespace numa {
+
+//Enables or disables binding of search threads and interleaving of the TT.
+void SetEnabled(bool enabled);
+bool IsEnabled();
+
+size_t GetNodeCount();
+
+//Restricts the calling thread to the cpus of the node assigned to search thread idx.
+//Threads are spread round robin over the nodes, the OS schedules them within a node.
+//Returns false if the thread could not be bound.
+bool BindThisThread(size_t idx);
+
+//Spreads the pages in [address, address + bytes) round robin over all nodes with
+//memory, migrating pages which were already touched. No-op on a single node.
+void Interleave(void *address, size_t bytes);
+
+}
+
+#endif /* GENERAL_NUMA_H_ */
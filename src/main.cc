@@ -46,6 +46,9 @@ int main(int argc, char **argv) {
     benchmark::RunBenchCommand(argc, argv);
     return 0;
   }
+  if (argc > 1 && Equals(argv[1], "ttstress")) {
+    return table::StressTest(16, 1000000) ? 0 : 1;
+  }
 
 //  train::RunEMForNFCM();
 //  evaluation::RunEMForGMM();
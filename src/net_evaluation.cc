@@ -40,33 +40,26 @@ struct CNNHelper {
   Square opp_k;
 };
 
-namespace pawn_hash {
-
-// long hits = 0;
-// long misses = 0;
+namespace net_evaluation {
 
-struct PawnEntry {
-  NetLayerType output;
-  HashType hash;
+// Keys fill the first cache line of a bucket and each CNN output one more, so a probe
+// touches at most two lines.
+struct alignas(64) PawnBucket {
+  static constexpr size_t kNumWays = 4;
+  std::array<HashType, kNumWays> keys;
+  // Ways are replaced in FIFO order.
+  uint32_t next_victim;
+  alignas(64) std::array<NetLayerType, kNumWays> outputs;
 };
+static_assert(sizeof(PawnBucket) == 5 * 64, "Pawn hash buckets should fill five cache lines.");
 
-size_t size = 10000;
+}
 
-std::vector<PawnEntry> table(size);
+namespace pawn_hash {
 
-PawnEntry GetEntry(const HashType hash_p) {
-  return table[hash_p % table.size()];
-}
-void SaveEntry(const NetLayerType &output, const HashType hash_p) {
-  PawnEntry entry;
-  entry.output = output;
-  entry.hash = hash_p ^ (HashType)std::round(output[0] * 1024);
-  table[hash_p % table.size()] = entry;
-}
+size_t bytes = 4 << 20;
 
-bool ValidateHash(const PawnEntry &entry, const HashType hash_p) {
-  return hash_p == (entry.hash ^ (HashType)std::round(entry.output[0] * 1024));
-}
+net_evaluation::PawnHash shared_table;
 
 }
 
@@ -271,9 +264,15 @@ std::array<BitBoard, 2> get_passed(const std::array<BitBoard, 2> &p_fill_forward
 
 struct EvalConstants;
 
+//Selects the slider indexing scheme of a constructor, see magic::SliderIndexing.
+template<magic::SliderIndexing indexing>
+using SliderIndexingTag = std::integral_constant<magic::SliderIndexing, indexing>;
+
 struct CheckingSquares {
+  template<magic::SliderIndexing indexing>
   CheckingSquares(const BitBoard all_pieces, const std::array<Square, 2> king_squares,
-                  const std::array<BitBoard, 2> c_pieces, const std::array<BitBoard, 2> controlled) :
+                  const std::array<BitBoard, 2> c_pieces, const std::array<BitBoard, 2> controlled,
+                  SliderIndexingTag<indexing>) :
     safe{{ {0, 0, 0, 0}, {0, 0, 0, 0} }},
     unsafe{{ {0, 0, 0, 0}, {0, 0, 0, 0} }}
   {
@@ -281,8 +280,8 @@ struct CheckingSquares {
       Color not_color = color ^ 0x1;
       Square enemy_king = king_squares[not_color];
       unsafe[color][kKnight - kKnight] = magic::GetAttackMap<kKnight>(enemy_king, all_pieces);
-      unsafe[color][kBishop - kKnight] = magic::GetAttackMap<kBishop>(enemy_king, all_pieces);
-      unsafe[color][kRook - kKnight] = magic::GetAttackMap<kRook>(enemy_king, all_pieces);
+      unsafe[color][kBishop - kKnight] = magic::GetAttackMap<kBishop, indexing>(enemy_king, all_pieces);
+      unsafe[color][kRook - kKnight] = magic::GetAttackMap<kRook, indexing>(enemy_king, all_pieces);
       unsafe[color][kQueen - kKnight] = unsafe[color][kRook - kKnight]
                                                  | unsafe[color][kBishop - kKnight];
       BitBoard safe_squares = ~(c_pieces[color] | controlled[not_color]);
@@ -298,7 +297,8 @@ struct CheckingSquares {
 };
 
 struct EvalConstants {
-  EvalConstants(const Board &board) :
+  template<magic::SliderIndexing indexing>
+  EvalConstants(const Board &board, SliderIndexingTag<indexing> tag) :
     king_squares({
         bitops::NumberOfTrailingZeros(board.get_piece_bitboard(kWhite, kKing)),
         bitops::NumberOfTrailingZeros(board.get_piece_bitboard(kBlack, kKing))
@@ -347,13 +347,13 @@ struct EvalConstants {
                   }),
     passed(get_passed(p_fill_forward, pawn_bb)),
     controlled({
-                board.PlayerBitBoardControl(kWhite, all_pieces),
-                board.PlayerBitBoardControl(kBlack, all_pieces)
+                board.get_all_attacks(kWhite),
+                board.get_all_attacks(kBlack)
               }),
     nbr_bitboard(board.get_piecetype_bitboard(kKnight)
                  | board.get_piecetype_bitboard(kBishop)
                  | board.get_piecetype_bitboard(kRook)),
-    checks(all_pieces, king_squares, c_pieces, controlled) {}
+    checks(all_pieces, king_squares, c_pieces, controlled, tag) {}
 
   const std::array<Square, 2> king_squares;           // Squares of each respective king
   const BitBoard all_major_pieces;                    // Kings, Queens and Rooks
@@ -445,7 +445,7 @@ inline void ScoreKnights(T &score, const Board &board, const EvalConstants &ec,
 //      int relative_x = GetSquareX(piece_square) - GetSquareX(enemy_king_square) + 7;
 //      int relative_y = GetSquareY(piece_square) - GetSquareY(enemy_king_square) + 7;
 //      AddFeature<T>(score, color, kKnightVsKingPosition + relative_king_map[relative_x + 15 * relative_y], 1);
-    BitBoard attack_map = magic::GetAttackMap<kKnight>(piece_square, ec.all_pieces);
+    BitBoard attack_map = board.get_square_attacks(piece_square);
     counter.unsafe += bitops::PopCount(attack_map
                                              & ec.checks.unsafe[color][kKnight-kKnight]);
     counter.safe += bitops::PopCount(attack_map
@@ -466,7 +466,7 @@ inline void ScoreKnights(T &score, const Board &board, const EvalConstants &ec,
           & (~ec.covered_potentially[not_color])));
 }
 
-template<typename T, Color color, Color our_color>
+template<typename T, Color color, Color our_color, magic::SliderIndexing indexing>
 inline void ScoreBishops(T &score, const Board &board, const EvalConstants &ec,
                         EvalCounter &counter, const BitBoard enemy_king_zone) {
   constexpr Color not_color = color ^ 0x1;
@@ -482,7 +482,7 @@ inline void ScoreBishops(T &score, const Board &board, const EvalConstants &ec,
     int relative_x = GetSquareX(piece_square) - GetSquareX(enemy_king_square) + 7;
     int relative_y = GetSquareY(piece_square) - GetSquareY(enemy_king_square) + 7;
     AddFeature<T>(score, offset + kBishopVsKingPosition + relative_king_map[relative_x + 15 * relative_y], 1);
-    BitBoard attack_map = magic::GetAttackMap<kBishop>(piece_square, ec.all_pieces)
+    BitBoard attack_map = board.get_square_attacks(piece_square)
         & (~ec.covered_once[not_color] | (ec.c_pieces[not_color] ^ ec.pawn_bb[not_color]));
     counter.unsafe += bitops::PopCount(attack_map
                                            & ec.checks.unsafe[color][kBishop-kKnight]);
@@ -495,7 +495,7 @@ inline void ScoreBishops(T &score, const Board &board, const EvalConstants &ec,
     }
     AddFeature<T>(score, offset + kBishopMobility
                   + bitops::PopCount(attack_map & ~ec.c_pieces[color]), 1);
-    abstract_targets |= magic::GetAttackMap<kBishop>(piece_square, ec.hard_block[color]);
+    abstract_targets |= magic::GetAttackMap<kBishop, indexing>(piece_square, ec.hard_block[color]);
   }
   bishop_targets &= ~ec.c_pieces[color];
   AddFeature<T>(score, offset + kMinorAttackIndex,
@@ -505,7 +505,7 @@ inline void ScoreBishops(T &score, const Board &board, const EvalConstants &ec,
       bitops::PopCount(abstract_targets));
 }
 
-template<typename T, Color color, Color our_color>
+template<typename T, Color color, Color our_color, magic::SliderIndexing indexing>
 inline void ScoreRooks(T &score, const Board &board, const EvalConstants &ec,
                        EvalCounter &counter, const BitBoard enemy_king_zone) {
   constexpr Color not_color = color ^ 0x1;
@@ -523,7 +523,7 @@ inline void ScoreRooks(T &score, const Board &board, const EvalConstants &ec,
         magic::GetSquareDistance(piece_square, ec.king_squares[not_color]));
     BitBoard attack_map = ~ec.c_pieces[color]
         & (~ec.covered_once[not_color] | (ec.c_pieces[not_color] ^ ec.pawn_bb[not_color]))
-        & magic::GetAttackMap<kRook>(piece_square, ec.all_pieces);
+        & board.get_square_attacks(piece_square);
     counter.unsafe += bitops::PopCount(attack_map
                                            & ec.checks.unsafe[color][kRook-kKnight]);
     counter.safe += bitops::PopCount(attack_map
@@ -533,14 +533,14 @@ inline void ScoreRooks(T &score, const Board &board, const EvalConstants &ec,
       counter.king_zone_attacks[kRook - kKnight]++;
     }
     BitBoard abstract_attack = attack_map ^
-        magic::GetAttackMap<kRook>(piece_square, ec.hard_block[color]);
+        magic::GetAttackMap<kRook, indexing>(piece_square, ec.hard_block[color]);
     AddFeature<T>(score, offset + kRookMobility + bitops::PopCount(attack_map), 1);
     AddFeature<T>(score, offset + kRook + kAbstractActivityIndex,
         bitops::PopCount(abstract_attack));
   }
 }
 
-template<typename T, Color color, Color our_color>
+template<typename T, Color color, Color our_color, magic::SliderIndexing indexing>
 inline void ScoreQueens(T &score, const Board &board, const EvalConstants &ec,
                         EvalCounter &counter, const BitBoard enemy_king_zone) {
   constexpr Color not_color = color ^ 0x1;
@@ -552,7 +552,7 @@ inline void ScoreQueens(T &score, const Board &board, const EvalConstants &ec,
         magic::GetSquareDistance(piece_square, ec.king_squares[not_color]));
     BitBoard attack_map = ~ec.c_pieces[color]
         & (~ec.covered_once[not_color] | (ec.c_pieces[not_color] ^ ec.pawn_bb[not_color]))
-        & magic::GetAttackMap<kQueen>(piece_square, ec.all_pieces);
+        & board.get_square_attacks(piece_square);
     counter.unsafe += bitops::PopCount(attack_map
                                            & ec.checks.unsafe[color][kQueen-kKnight]);
     counter.safe += bitops::PopCount(attack_map
@@ -564,7 +564,7 @@ inline void ScoreQueens(T &score, const Board &board, const EvalConstants &ec,
     AddFeature<T>(score, offset + kQueenMobility + std::min(bitops::PopCount(attack_map), 24), 1);
     if (kUseQueenActivity) {
       BitBoard abstract_attack = attack_map ^
-          magic::GetAttackMap<kQueen>(piece_square, ec.hard_block[color]);
+          magic::GetAttackMap<kQueen, indexing>(piece_square, ec.hard_block[color]);
       AddFeature<T>(score, offset + kQueen + kActivityBonusIndex,
                     bitops::PopCount(attack_map));
       AddFeature<T>(score, offset + kQueen + kAbstractActivityIndex,
@@ -573,7 +573,7 @@ inline void ScoreQueens(T &score, const Board &board, const EvalConstants &ec,
   }
 }
 
-template<typename T, Color color, Color our_color>
+template<typename T, Color color, Color our_color, magic::SliderIndexing indexing>
 inline void ScoreKings(T &score, const Board &board,
                        const EvalConstants &ec, const EvalCounter &counter) {
   constexpr Color not_color = color ^ 0x1;
@@ -583,21 +583,21 @@ inline void ScoreKings(T &score, const Board &board,
 
   if (board.get_piece_bitboard(not_color, kQueen)) {
     AddFeature<T>(score, offset + kKingVectorExposure,
-                  bitops::PopCount(magic::GetAttackMap<kBishop>(king_square,
+                  bitops::PopCount(magic::GetAttackMap<kBishop, indexing>(king_square,
                                        board.get_piece_bitboard(color, kPawn))));
     AddFeature<T>(score, offset + kKingVectorExposure + 1,
-                  bitops::PopCount(magic::GetAttackMap<kRook>(king_square,
+                  bitops::PopCount(magic::GetAttackMap<kRook, indexing>(king_square,
                                        board.get_piece_bitboard(color, kPawn))));
   }
   else {
     if (board.get_piece_bitboard(not_color, kBishop)) {
       AddFeature<T>(score, offset + kKingVectorExposure,
-                    bitops::PopCount(magic::GetAttackMap<kBishop>(king_square,
+                    bitops::PopCount(magic::GetAttackMap<kBishop, indexing>(king_square,
                                          board.get_piece_bitboard(color, kPawn))));
     }
     if (board.get_piece_bitboard(not_color, kRook)) {
       AddFeature<T>(score, offset + kKingVectorExposure + 1,
-                    bitops::PopCount(magic::GetAttackMap<kRook>(king_square,
+                    bitops::PopCount(magic::GetAttackMap<kRook, indexing>(king_square,
                                          board.get_piece_bitboard(color, kPawn))));
     }
   }
@@ -656,7 +656,7 @@ inline T GetSuperStaticRawFeatures(const Board &board, const EvalConstants &ec,
   return score;
 }
 
-template<typename T, Color color, Color our_color>
+template<typename T, Color color, Color our_color, magic::SliderIndexing indexing>
 inline void ScorePieces(T &score, const Board &board, const EvalConstants &ec,
                         EvalCounter &counter) {
   const BitBoard enemy_king_zone = magic::GetKingArea(ec.king_squares[color ^ 0x1]);
@@ -664,10 +664,10 @@ inline void ScorePieces(T &score, const Board &board, const EvalConstants &ec,
   ScorePawnThreats<T, color, our_color>(score, ec);
   // ScorePawns<T, color, our_color>(score, ec);
   ScoreKnights<T, color, our_color>(score, board, ec, counter, enemy_king_zone);
-  ScoreBishops<T, color, our_color>(score, board, ec, counter, enemy_king_zone);
-  ScoreRooks<T, color, our_color>(score, board, ec, counter, enemy_king_zone);
-  ScoreQueens<T, color, our_color>(score, board, ec, counter, enemy_king_zone);
-  ScoreKings<T, color, our_color>(score, board, ec, counter);
+  ScoreBishops<T, color, our_color, indexing>(score, board, ec, counter, enemy_king_zone);
+  ScoreRooks<T, color, our_color, indexing>(score, board, ec, counter, enemy_king_zone);
+  ScoreQueens<T, color, our_color, indexing>(score, board, ec, counter, enemy_king_zone);
+  ScoreKings<T, color, our_color, indexing>(score, board, ec, counter);
 }
 
 template<typename T, Color color, Color our_color>
@@ -715,12 +715,38 @@ inline void AddCommonFeatures(T &score, const Board &board, const EvalConstants
 
 namespace net_evaluation {
 
-void SetPHashSize(const size_t bytes) {
-  pawn_hash::size = bytes / 72;
-  pawn_hash::table.resize(pawn_hash::size);
+PawnHash::PawnHash() : buckets(nullptr), num_buckets(0) {
+  resize(pawn_hash::bytes);
 }
 
-template<typename T, Color our_color>
+PawnHash::~PawnHash() {
+  large_pages::Free(allocation);
+}
+
+void PawnHash::resize(const size_t bytes) {
+  large_pages::Free(allocation);
+  num_buckets = std::max(bytes / sizeof(PawnBucket), static_cast<size_t>(1));
+  allocation = large_pages::Allocate(num_buckets * sizeof(PawnBucket));
+  if (allocation.memory == nullptr) {
+    throw std::bad_alloc();
+  }
+  buckets = static_cast<PawnBucket*>(allocation.memory);
+}
+
+PawnBucket &PawnHash::get_bucket(const HashType hash_p) {
+  return buckets[static_cast<size_t>((static_cast<unsigned __int128>(hash_p) * num_buckets) >> 64)];
+}
+
+void SetPawnHashSize(const size_t bytes) {
+  pawn_hash::bytes = bytes;
+  pawn_hash::shared_table.resize(bytes);
+}
+
+size_t GetPawnHashSize() {
+  return pawn_hash::bytes;
+}
+
+template<typename T, Color our_color, magic::SliderIndexing indexing>
 T ScoreBoard(const Board &board, const EvalConstants &ec) {
   T score = init<T>();
 
@@ -737,8 +763,8 @@ T ScoreBoard(const Board &board, const EvalConstants &ec) {
 
   // Piece evaluations
   std::array<EvalCounter, 2> check_counter;
-  ScorePieces<T, kWhite, our_color>(score, board, ec, check_counter[kWhite]);
-  ScorePieces<T, kBlack, our_color>(score, board, ec, check_counter[kBlack]);
+  ScorePieces<T, kWhite, our_color, indexing>(score, board, ec, check_counter[kWhite]);
+  ScorePieces<T, kBlack, our_color, indexing>(score, board, ec, check_counter[kBlack]);
 
   // Features picked up while iterating over pieces
   AddFeaturePair<T, our_color>(score, kSafeChecks, check_counter[kWhite].safe, check_counter[kBlack].safe);
@@ -823,26 +849,38 @@ Score NetForward(NetLayerType &layer_one) {
 }
 
 Score ScoreBoard(const Board &board) {
-  const EvalConstants ec(board);
-  HashType p_hash = board.get_pawn_hash();
-  pawn_hash::PawnEntry entry = pawn_hash::GetEntry(p_hash);
+  return ScoreBoard(board, pawn_hash::shared_table);
+}
+
+template<magic::SliderIndexing indexing>
+Score ScoreBoard(const Board &board, PawnHash &pawn_hash) {
+  const EvalConstants ec(board, SliderIndexingTag<indexing>());
+  const HashType p_hash = board.get_pawn_hash();
+  PawnBucket &bucket = pawn_hash.get_bucket(p_hash);
+  size_t way = 0;
+  while (way < PawnBucket::kNumWays && bucket.keys[way] != p_hash) {
+    ++way;
+  }
   NetLayerType cnn_out;
-  if (pawn_hash::ValidateHash(entry, p_hash)) {
-    cnn_out = entry.output;
+  if (way < PawnBucket::kNumWays) {
+    cnn_out = bucket.outputs[way];
   }
   else {
     CNNHelper helper;
     CNNLayerType cnn_input = GetSuperStaticRawFeatures<CNNLayerType>(board, ec, helper);
     cnn_out = NetForward(cnn_input, helper);
-    pawn_hash::SaveEntry(cnn_out, p_hash);
+    way = bucket.next_victim;
+    bucket.next_victim = (way + 1) % PawnBucket::kNumWays;
+    bucket.keys[way] = p_hash;
+    bucket.outputs[way] = cnn_out;
   }
 
   NetLayerType layer_one = init<NetLayerType>();
   if (board.get_turn() == kWhite) {
-    layer_one = ScoreBoard<NetLayerType, kWhite>(board, ec);
+    layer_one = ScoreBoard<NetLayerType, kWhite, indexing>(board, ec);
   }
   else {
-    layer_one = ScoreBoard<NetLayerType, kBlack>(board, ec);
+    layer_one = ScoreBoard<NetLayerType, kBlack, indexing>(board, ec);
   }
   layer_one += cnn_out;
   if (contempt[board.get_turn()] != 0) {
@@ -851,6 +889,13 @@ Score ScoreBoard(const Board &board) {
   return NetForward(layer_one);
 }
 
+Score ScoreBoard(const Board &board, PawnHash &pawn_hash) {
+  if (magic::GetSliderIndexing() == magic::SliderIndexing::kPext) {
+    return ScoreBoard<magic::SliderIndexing::kPext>(board, pawn_hash);
+  }
+  return ScoreBoard<magic::SliderIndexing::kMagic>(board, pawn_hash);
+}
+
 template<size_t size>
 void init_cnn_weights(Array3d<FNetLayerType, 3, 3, 16> &cnn_filters, const std::array<float, size> &weights,
                       double multiplier = 1.0) {
@@ -991,18 +1036,34 @@ void init_weights() {
   win_draw_bias = net_hardcode::bias_win_draw;
 }
 
+template<magic::SliderIndexing indexing>
 std::vector<int32_t> GetCNNInputs(const Board &board) {
-  const EvalConstants ec(board);
+  const EvalConstants ec(board, SliderIndexingTag<indexing>());
   CNNHelper helper;
   return GetSuperStaticRawFeatures<std::vector<int32_t> >(board, ec, helper);
 }
 
+std::vector<int32_t> GetCNNInputs(const Board &board) {
+  if (magic::GetSliderIndexing() == magic::SliderIndexing::kPext) {
+    return GetCNNInputs<magic::SliderIndexing::kPext>(board);
+  }
+  return GetCNNInputs<magic::SliderIndexing::kMagic>(board);
+}
+
+template<magic::SliderIndexing indexing>
 std::vector<int32_t> GetNetInputs(const Board &board) {
-  const EvalConstants ec(board);
+  const EvalConstants ec(board, SliderIndexingTag<indexing>());
   if (board.get_turn() == kWhite) {
-    return ScoreBoard<std::vector<int32_t>, kWhite>(board, ec);
+    return ScoreBoard<std::vector<int32_t>, kWhite, indexing>(board, ec);
+  }
+  return ScoreBoard<std::vector<int32_t>, kBlack, indexing>(board, ec);
+}
+
+std::vector<int32_t> GetNetInputs(const Board &board) {
+  if (magic::GetSliderIndexing() == magic::SliderIndexing::kPext) {
+    return GetNetInputs<magic::SliderIndexing::kPext>(board);
   }
-  return ScoreBoard<std::vector<int32_t>, kBlack>(board, ec);
+  return GetNetInputs<magic::SliderIndexing::kMagic>(board);
 }
 
 #ifdef EVAL_TRAINING
@@ -33,17 +33,48 @@
 #include "general/types.h"
 #include "general/settings.h"
 #include "board.h"
+#include "general/large_pages.h"
 #include <vector>
 
 namespace net_evaluation {
 
+struct PawnBucket;
+
+// Set associative cache of the CNN output, keyed by the pawn/king hash. Every search
+// thread owns one, so probes and stores need no synchronization.
+class PawnHash {
+public:
+  PawnHash();
+  ~PawnHash();
+  PawnHash(const PawnHash&) = delete;
+  PawnHash& operator=(const PawnHash&) = delete;
+
+  // Contents are dropped, the new table is empty.
+  void resize(size_t bytes);
+  PawnBucket &get_bucket(const HashType hash_p);
+  // Starts loading the keys of the bucket of hash_p into the cache.
+  void prefetch(const HashType hash_p) {
+    __builtin_prefetch(&get_bucket(hash_p));
+  }
+
+private:
+  large_pages::Allocation allocation;
+  PawnBucket *buckets;
+  size_t num_buckets;
+};
+
+// Evaluates the board using the pawn hash of the calling search thread.
+Score ScoreBoard(const Board &board, PawnHash &pawn_hash);
+// Evaluates the board using a pawn hash which is shared by all callers outside of search.
 Score ScoreBoard(const Board &board);
 // Returns the input features for the net for a specific board position.
 // In the future this may become more complicated, depending on how pieces get encoded.
 std::vector<int32_t> GetNetInputs(const Board &board);
 void init_weights();
 
-void SetPHashSize(const size_t bytes);
+// Sets the size of pawn hash tables created from now on and resizes the shared one.
+void SetPawnHashSize(const size_t bytes);
+size_t GetPawnHashSize();
 
 #ifdef EVAL_TRAINING
 void GenerateDatasetFromEPD();
@@ -0,0 +1,165 @@
+/*
+ *  Winter is a UCI chess engine.
+ *
+ *  Copyright (C) 2016 Jonas Kuratli, Jonathan Maurer, Jonathan Rosenthal
+ *  Copyright (C) 2017-2018 Jonathan Rosenthal
+ *
+ *  Winter is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Winter is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * perft.cc
+ *
+ *  Multithreaded perft with bulk counting and a shared hash table of subtree
+ *  counts. Used to validate move generation and measure its throughput.
+ */
+
+#include "perft.h"
+#include "general/parse.h"
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct PerftStats {
+  size_t nodes = 0;
+  size_t probes = 0;
+  size_t hits = 0;
+  Milliseconds time = Milliseconds(0);
+};
+
+size_t HashedPerft(Board &board, const Depth depth, perft::Table &table, PerftStats &stats) {
+  // Bulk counting, at depth 1 the number of legal moves is the number of leaves.
+  if (depth <= 1) {
+    return depth == 1 ? board.GetMoves<kNonQuiescent>().size() : 1;
+  }
+  const HashType hash = board.get_hash();
+  size_t count;
+  stats.probes++;
+  if (table.probe(hash, depth, count)) {
+    stats.hits++;
+    return count;
+  }
+  count = 0;
+  MoveList moves = board.GetMoves<kNonQuiescent>();
+  for (Move move : moves) {
+    board.Make(move);
+    count += HashedPerft(board, depth - 1, table, stats);
+    board.UnMake();
+  }
+  table.save(hash, depth, count);
+  return count;
+}
+
+}
+
+namespace perft {
+
+Table::Table(const size_t megabytes) :
+    size(std::max<size_t>(1, (megabytes << 20) / sizeof(Entry))),
+    table(new Entry[size]()) {}
+
+bool Table::probe(const HashType hash, const Depth depth, size_t &count) const {
+  const Entry &entry = table[hash % size];
+  const uint64_t data = entry.data.load(std::memory_order_relaxed);
+  const uint64_t key = entry.key.load(std::memory_order_relaxed);
+  if ((key ^ data) != hash || static_cast<Depth>(data & 0xFF) != depth) {
+    return false;
+  }
+  count = data >> 8;
+  return true;
+}
+
+void Table::save(const HashType hash, const Depth depth, const size_t count) {
+  Entry &entry = table[hash % size];
+  const uint64_t data = (static_cast<uint64_t>(count) << 8) | depth;
+  entry.key.store(hash ^ data, std::memory_order_relaxed);
+  entry.data.store(data, std::memory_order_relaxed);
+}
+
+void Table::clear() {
+  for (size_t i = 0; i < size; ++i) {
+    table[i].key.store(0, std::memory_order_relaxed);
+    table[i].data.store(0, std::memory_order_relaxed);
+  }
+}
+
+size_t ParallelPerft(const Board &board, const Depth depth, const size_t num_threads,
+                     const size_t hash_megabytes, const bool print_info) {
+  Table table(hash_megabytes);
+  return ParallelPerft(board, depth, num_threads, table, print_info);
+}
+
+size_t ParallelPerft(const Board &board, const Depth depth, const size_t num_threads,
+                     Table &table, const bool print_info) {
+  if (depth <= 0) {
+    return 1;
+  }
+  Board root_board = board.copy();
+  const MoveList moves = root_board.GetMoves<kNonQuiescent>();
+  std::vector<size_t> results(moves.size(), 0);
+  std::vector<PerftStats> stats(std::max<size_t>(num_threads, 1));
+  std::atomic<size_t> next_move(0);
+
+  // Threads grab the next unsearched root move until none are left.
+  auto worker = [&](const size_t id) {
+    Time begin = now();
+    Board thread_board = board.copy();
+    for (size_t i = next_move++; i < moves.size(); i = next_move++) {
+      thread_board.Make(moves[i]);
+      results[i] = HashedPerft(thread_board, depth - 1, table, stats[id]);
+      thread_board.UnMake();
+      stats[id].nodes += results[i];
+    }
+    stats[id].time = std::chrono::duration_cast<Milliseconds>(now() - begin);
+  };
+
+  Time begin = now();
+  std::vector<std::thread> threads;
+  for (size_t id = 1; id < stats.size(); ++id) {
+    threads.emplace_back(worker, id);
+  }
+  worker(0);
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  auto time_used = std::chrono::duration_cast<Milliseconds>(now() - begin);
+
+  size_t sum = 0;
+  for (size_t i = 0; i < moves.size(); ++i) {
+    sum += results[i];
+    if (print_info) {
+      std::cout << parse::MoveToString(moves[i]) << " depth: " << (depth-1)
+          << " perft: " << results[i] << std::endl;
+    }
+  }
+  if (print_info) {
+    std::cout << "Ended perft" << std::endl;
+    std::cout << "depth: " << depth << " perft: " << sum << " time: " << time_used.count()
+        << " nps: " << ((sum * 1000) / (time_used.count() + 1)) << std::endl;
+    for (size_t id = 0; id < stats.size(); ++id) {
+      const double hit_rate = stats[id].probes ? (100.0 * stats[id].hits) / stats[id].probes : 0;
+      std::cout << "thread: " << id << " perft: " << stats[id].nodes
+          << " nps: " << ((stats[id].nodes * 1000) / (stats[id].time.count() + 1))
+          << " hash hits: " << std::fixed << std::setprecision(1) << hit_rate << "%"
+          << std::defaultfloat << std::endl;
+    }
+  }
+  return sum;
+}
+
+}
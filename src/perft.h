@@ -0,0 +1,72 @@
+/*
+ *  Winter is a UCI chess engine.
+ *
+ *  Copyright (C) 2016 Jonas Kuratli, Jonathan Maurer, Jonathan Rosenthal
+ *  Copyright (C) 2017-2018 Jonathan Rosenthal
+ *
+ *  Winter is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Winter is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * perft.h
+ *
+ *  Multithreaded perft with bulk counting and a shared hash table of subtree
+ *  counts. Used to validate move generation and measure its throughput.
+ */
+
+#ifndef SRC_PERFT_H_
+#define SRC_PERFT_H_
+
+#include "board.h"
+#include "general/types.h"
+#include <atomic>
+#include <memory>
+
+namespace perft {
+
+// Default size of the perft hash table in MB, can be overridden by the perft command.
+constexpr size_t kPerftHashMB = 64;
+
+// Hash table of subtree counts shared by all perft threads. Entries are written without
+// locks. The key is stored XORed with the data, so an entry torn by concurrent writes
+// fails validation instead of returning a wrong count.
+class Table {
+public:
+  Table(const size_t megabytes);
+
+  bool probe(const HashType hash, const Depth depth, size_t &count) const;
+  void save(const HashType hash, const Depth depth, const size_t count);
+  void clear();
+
+private:
+  struct Entry {
+    std::atomic<uint64_t> key;
+    std::atomic<uint64_t> data;
+  };
+  const size_t size;
+  std::unique_ptr<Entry[]> table;
+};
+
+// Counts the leaf nodes of the legal move tree of depth param depth. Root moves are
+// split over num_threads threads which share a hash table of hash_megabytes MB.
+// If print_info is set, the count for each root move and per thread statistics are printed.
+size_t ParallelPerft(const Board &board, const Depth depth, const size_t num_threads,
+                     const size_t hash_megabytes, const bool print_info);
+
+// As above, but uses the caller's table, which is not cleared.
+size_t ParallelPerft(const Board &board, const Depth depth, const size_t num_threads,
+                     Table &table, const bool print_info);
+
+}
+
+#endif /* SRC_PERFT_H_ */
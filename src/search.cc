@@ -41,7 +41,6 @@
 #include <cassert>
 #include <iostream>
 #include <fstream>
-#include <mutex>
 #include <random>
 #include <utility>
 
@@ -170,16 +169,6 @@ struct Sorter {
   };
 };
 
-bool SwapToFront(std::vector<Move> &moves, const Move move) {
-  for (size_t i = 0; i < moves.size(); ++i) {
-    if (moves[i] == move) {
-      std::swap(moves[i], moves[0]);
-      return true;
-    }
-  }
-  return false;
-}
-
 std::mt19937_64 rng;
 size_t min_ply = 0;
 const size_t kInfiniteNodes = 1000000000000;
@@ -194,7 +183,7 @@ inline bool finished(search::Thread &thread) {
   if (thread.id == 0) {
     if (skip_time_check <= 0) {
       skip_time_check = 256;
-      return end_time <= now() || max_nodes < search::Threads.get_node_count()
+      return end_time <= now() || max_nodes < search::Threads.get_node_count_from_main()
                                || search::Threads.end_search.load(std::memory_order_relaxed);
     }
     skip_time_check--;
@@ -254,13 +243,14 @@ MoveScore get_move_priority(const Move move, search::Thread &t, const Move best)
   return t.get_history_score(t.board.get_turn(), GetMoveSource(move), GetMoveDestination(move)) / 1000;
 }
 
-void SortMoves(std::vector<Move> &moves, search::Thread &t, const Move best_move) {
+void SortMoves(MoveList &moves, search::Thread &t, const Move best_move) {
+  std::array<Move, kMaxNumMoves> scored_moves;
   for (size_t i = 0; i < moves.size(); ++i) {
-    moves[i] |= (get_move_priority(moves[i], t, best_move) << 16);
+    scored_moves[i] = moves[i] | (get_move_priority(moves[i], t, best_move) << 16);
   }
-  std::sort(moves.begin(), moves.end(), Sorter());
+  std::sort(scored_moves.begin(), scored_moves.begin() + moves.size(), Sorter());
   for (size_t i = 0; i < moves.size(); ++i) {
-    moves[i] &= 0xFFFFL;
+    moves[i] = scored_moves[i] & 0xFFFFL;
   }
 }
 
@@ -329,20 +319,10 @@ inline BitBoard get_under_threat_squares(const Board &board) {
   if (board.get_num_made_moves() == 0) {
     return 0;
   }
-  BitBoard pot_targets;
-  const Move last_move = board.get_last_move();
-  const PieceType moved_piece = GetPieceType(board.get_piece(GetMoveDestination(last_move)));
-  if (moved_piece == kPawn) {
-    BitBoard move_des = GetSquareBitBoard(GetMoveDestination(last_move));
-    if (board.get_turn() == kWhite) {
-      pot_targets = bitops::SE(move_des) | bitops::SW(move_des);
-    }
-    else {
-      pot_targets = bitops::NE(move_des) | bitops::NW(move_des);
-    }
-  }
-  else {
-    pot_targets = magic::GetAttackMap(moved_piece, GetMoveDestination(last_move), board.get_all_pieces());
+  const Square destination = GetMoveDestination(board.get_last_move());
+  BitBoard pot_targets = 0;
+  if (GetPieceType(board.get_piece(destination)) != kKing) {
+    pot_targets = board.get_square_attacks(destination);
   }
   pot_targets &= board.get_color_bitboard(board.get_turn());
   BitBoard targets = 0;
@@ -497,27 +477,214 @@ T GetMoveWeight(const Move move, search::Thread &t, const MoveOrderInfo &info) {
 }
 
 // Sorten moves according to weights given by some classifier
-void SortMovesML(std::vector<Move> &moves, search::Thread &t, const Move best_move = kNullMove) {
+void SortMovesML(MoveList &moves, search::Thread &t, const Move best_move = kNullMove) {
   MoveOrderInfo info(t.board, best_move);
+  std::array<Move, kMaxNumMoves> scored_moves;
 
   //Move ordering is very different if we are in check. Eg a queen move not capturing anything is less likely.
   if (t.board.InCheck()) {
     for (size_t i = 0; i < moves.size(); ++i) {
-      moves[i] |= ((10000 + GetMoveWeight<MoveScore, true>(moves[i], t, info)) << 16);
+      scored_moves[i] = moves[i] | ((10000 + GetMoveWeight<MoveScore, true>(moves[i], t, info)) << 16);
     }
   }
   else {
     for (size_t i = 0; i < moves.size(); ++i) {
-      moves[i] |= ((10000 + GetMoveWeight<MoveScore, false>(moves[i], t, info)) << 16);
+      scored_moves[i] = moves[i] | ((10000 + GetMoveWeight<MoveScore, false>(moves[i], t, info)) << 16);
     }
   }
 
-  std::sort(moves.begin(), moves.end(), Sorter());
+  std::sort(scored_moves.begin(), scored_moves.begin() + moves.size(), Sorter());
   for (size_t i = 0; i < moves.size(); ++i) {
-    moves[i] &= 0xFFFFL;
+    moves[i] = scored_moves[i] & 0xFFFFL;
+  }
+}
+
+// Returns the best scored move in [begin, end) after swapping it to begin.
+// Used for partial selection sort, so we only pay for the moves we search.
+inline Move PickBest(std::array<Move, kMaxNumMoves> &scored_moves, size_t begin, size_t end) {
+  size_t best = begin;
+  for (size_t i = begin + 1; i < end; ++i) {
+    if ((scored_moves[i] >> 16) > (scored_moves[best] >> 16)) {
+      best = i;
+    }
   }
+  std::swap(scored_moves[begin], scored_moves[best]);
+  return scored_moves[begin] & 0xFFFFL;
 }
 
+enum class PickerStage {
+  kTTMove, kGoodCaptures, kRefutations, kQuiets, kBadCaptures, kEvasions, kDone
+};
+
+// Staged move picker for AlphaBeta. The TT move is returned before any moves are
+// generated, afterwards good captures are returned in MVV-LVA order, followed by
+// killers and the counter move, the remaining quiet moves and finally captures
+// which lose material and underpromotions. Quiet moves are only scored with the
+// move ordering weights once they are actually needed.
+class MovePicker {
+public:
+  MovePicker(search::Thread &t_, const Move tt_move_, const bool in_check_) : t(t_),
+      stage(PickerStage::kTTMove), tt_move(kNullMove), in_check(in_check_), generated(false), current(0), num_captures(0),
+      num_bad_captures(0), num_moves(0), refutation_idx(0) {
+    if (tt_move_ != kNullMove && t.board.IsMoveLegal(tt_move_)) {
+      tt_move = tt_move_;
+    }
+  }
+
+  // Returns kNullMove once all legal moves have been returned.
+  Move next() {
+    while (true) {
+      switch (stage) {
+        case PickerStage::kTTMove:
+          stage = in_check ? PickerStage::kEvasions : PickerStage::kGoodCaptures;
+          if (tt_move != kNullMove) {
+            return tt_move;
+          }
+          break;
+        case PickerStage::kGoodCaptures:
+          generate();
+          if (current < num_captures) {
+            return PickBest(scored_moves, current++, num_captures);
+          }
+          stage = PickerStage::kRefutations;
+          current = num_captures + num_bad_captures;
+          break;
+        case PickerStage::kRefutations:
+          while (refutation_idx < 3) {
+            const Move move = get_refutation(refutation_idx++);
+            if (move != kNullMove && remove_quiet(move)) {
+              return move;
+            }
+          }
+          stage = PickerStage::kQuiets;
+          score_quiets();
+          break;
+        case PickerStage::kQuiets:
+          if (current < num_moves) {
+            return PickBest(scored_moves, current++, num_moves);
+          }
+          stage = PickerStage::kBadCaptures;
+          current = num_captures;
+          break;
+        case PickerStage::kBadCaptures:
+          if (current < num_captures + num_bad_captures) {
+            return PickBest(scored_moves, current++, num_captures + num_bad_captures);
+          }
+          stage = PickerStage::kDone;
+          break;
+        case PickerStage::kEvasions:
+          generate();
+          if (current < num_moves) {
+            return PickBest(scored_moves, current++, num_moves);
+          }
+          stage = PickerStage::kDone;
+          break;
+        case PickerStage::kDone:
+          return kNullMove;
+      }
+    }
+  }
+
+  // Returns all legal moves including the TT move, generating them if necessary.
+  const MoveList &get_moves() {
+    generate();
+    return moves;
+  }
+
+private:
+  // Moves are stored in scored_moves in the following order: good captures,
+  // bad captures and finally quiet moves. In check all moves are scored together.
+  void generate() {
+    if (generated) {
+      return;
+    }
+    generated = true;
+    moves = t.board.GetMoves<kNonQuiescent>();
+    if (in_check) {
+      MoveOrderInfo info(t.board, tt_move);
+      for (Move move : moves) {
+        if (move != tt_move) {
+          scored_moves[num_moves++] = move | ((10000 + GetMoveWeight<MoveScore, true>(move, t, info)) << 16);
+        }
+      }
+      return;
+    }
+    std::array<Move, kMaxNumMoves> bad_captures;
+    for (Move move : moves) {
+      if (move == tt_move || !IsMoveForcing(move)) {
+        continue;
+      }
+      const MoveType move_type = GetMoveType(move);
+      const PieceType moving_piece = GetPieceType(t.board.get_piece(GetMoveSource(move)));
+      PieceType target = GetPieceType(t.board.get_piece(GetMoveDestination(move)));
+      if (target == kNoPiece) {
+        target = kPawn;
+      }
+      const MoveScore score = 10 * target - moving_piece + (move_type == kQueenPromotion) * 50;
+      if ((move_type > kCapture && move_type != kQueenPromotion)
+          || (move_type == kCapture && target < moving_piece && !t.board.NonNegativeSEE(move))) {
+        bad_captures[num_bad_captures++] = move | ((100 + score) << 16);
+      }
+      else {
+        scored_moves[num_captures++] = move | ((100 + score) << 16);
+      }
+    }
+    std::copy(bad_captures.begin(), bad_captures.begin() + num_bad_captures,
+              scored_moves.begin() + num_captures);
+    num_moves = num_captures + num_bad_captures;
+    for (Move move : moves) {
+      if (move != tt_move && !IsMoveForcing(move)) {
+        scored_moves[num_moves++] = move;
+      }
+    }
+  }
+
+  Move get_refutation(const size_t idx) const {
+    const size_t num_made_moves = t.board.get_num_made_moves();
+    if (idx < 2) {
+      return t.killers[num_made_moves][idx];
+    }
+    if (num_made_moves > 0 && t.board.get_last_move() != kNullMove) {
+      const Square last_destination = GetMoveDestination(t.board.get_last_move());
+      const PieceType last_moved_piece = GetPieceType(t.board.get_piece(last_destination));
+      return t.counter_moves[t.board.get_turn()][last_moved_piece][last_destination];
+    }
+    return kNullMove;
+  }
+
+  // Removes move from the remaining quiet moves. Returns false if the move
+  // is not a legal quiet move or has already been returned.
+  bool remove_quiet(const Move move) {
+    for (size_t i = current; i < num_moves; ++i) {
+      if ((scored_moves[i] & 0xFFFFL) == move) {
+        scored_moves[i] = scored_moves[--num_moves];
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void score_quiets() {
+    if (current == num_moves) {
+      return;
+    }
+    MoveOrderInfo info(t.board, tt_move);
+    for (size_t i = current; i < num_moves; ++i) {
+      const Move move = scored_moves[i];
+      scored_moves[i] = move | ((10000 + GetMoveWeight<MoveScore, false>(move, t, info)) << 16);
+    }
+  }
+
+  search::Thread &t;
+  PickerStage stage;
+  Move tt_move;
+  const bool in_check;
+  bool generated;
+  size_t current, num_captures, num_bad_captures, num_moves, refutation_idx;
+  MoveList moves;
+  std::array<Move, kMaxNumMoves> scored_moves;
+};
+
 // Recursively build PV from TT up to param depth
 void build_pv(Board &board, std::vector<Move> &pv);
 
@@ -537,7 +704,7 @@ void build_pv(Board &board, std::vector<Move> &pv) {
   bool entry_verified = table::ValidateHash(entry, board.get_hash());
 
   if (entry_verified) {
-    std::vector<Move> moves = board.GetMoves<kNonQuiescent>();
+    MoveList moves = board.GetMoves<kNonQuiescent>();
     for (Move move : moves) {
       if ((move == entry.get_best_move() && entry_verified)) {
         return build_pv(board, pv, move);
@@ -550,7 +717,7 @@ inline bool sufficient_bounds(const Board &board, const table::Entry &entry,
                               const Score alpha, const Score beta,
                               const Depth depth) {
   Score score = entry.get_score(board);
-  return entry.depth >= depth
+  return entry.get_depth() >= depth
       && ((entry.get_bound() == kExactBound)
           || (entry.get_bound() == kLowerBound && score >= beta)
           || (entry.get_bound() == kUpperBound && score <= alpha));
@@ -562,10 +729,18 @@ inline bool is_null_move_allowed(const Board &board, const Depth depth) {
       //&& board.get_phase() > 1 * piece_phases[kQueen];// && !board.InCheck();
 }
 
+//Makes the move and starts loading the TT bucket and pawn hash bucket of the new position.
+//The misses then overlap with the draw checks and bookkeeping before the child probes them.
+inline void MakeAndPrefetch(search::Thread &t, const Move move) {
+  t.board.Make(move);
+  table::Prefetch(t.board.get_hash());
+  t.pawn_hash.prefetch(t.board.get_pawn_hash());
+}
+
 #ifdef UNUSED
 //This tested negative, may revisit in the future.
 inline bool cutoff_is_prefetchable(Board &board, const Score alpha, const Score beta,
-                                const Depth depth, const std::vector<Move> &moves) {
+                                const Depth depth, const MoveList &moves) {
   for (Move move : moves) {
     board.Make(move);
     if (alpha >= 0 && board.IsDraw()) {
@@ -589,42 +764,23 @@ inline bool cutoff_is_prefetchable(Board &board, const Score alpha, const Score
 
 namespace search {
 
-std::vector<Move> GetSortedMovesML(Board &board) {
-  std::vector<Move> moves = board.GetMoves<kNonQuiescent>();
+MoveList GetSortedMovesML(Board &board) {
+  MoveList moves = board.GetMoves<kNonQuiescent>();
   Threads.main_thread->board.SetToSamePosition(board);
   SortMovesML(moves, *Threads.main_thread);
   return moves;
 }
 
-size_t Perft(Board &board, Depth depth) {
-  if (depth <= 0) {
-    return 1;
-  }
-  if (depth == 1) {
-    return board.GetMoves<kNonQuiescent>().size();
-  }
-  size_t perft_sum = 0;
-  std::vector<Move> moves = board.GetMoves<kNonQuiescent>();
-  for (Move move : moves) {
-    board.Make(move);
-    perft_sum += Perft(board, depth-1);
-    board.UnMake();
-  }
-  return perft_sum;
-}
-
 Board get_sampled_board() {
   return sampled_board;
 }
 
 Score QuiescentSearch(Thread &t, Score alpha, const Score beta) {
   assert(beta > alpha);
-  t.nodes++;
+  t.count_node();
   Score lower_bound_score = GetMatedOnMoveScore(t.board.get_num_made_moves());
   //Update max ply reached in search
-  if (t.max_depth < t.board.get_num_made_moves()) {
-    t.max_depth = t.board.get_num_made_moves();
-  }
+  t.update_max_depth(t.board.get_num_made_moves());
 
   //End search immediately if trivial draw is reached
   if (t.board.IsTriviallyDrawnEnding()) {
@@ -648,7 +804,7 @@ Score QuiescentSearch(Thread &t, Score alpha, const Score beta) {
   bool in_check = t.board.InCheck();
   Score static_eval = kMinScore;
   if (!in_check) {
-    static_eval = net_evaluation::ScoreBoard(t.board);
+    static_eval = net_evaluation::ScoreBoard(t.board, t.pawn_hash);
 //    std::cout << "QS Eval return: (w:" << static_eval.win << ", wd:" << static_eval.win_draw << ")" << std::endl;
     if (valid_hash && entry.get_bound() == kLowerBound && static_eval < entry.get_score(t.board)) {
       static_eval = entry.get_score(t.board);
@@ -667,7 +823,7 @@ Score QuiescentSearch(Thread &t, Score alpha, const Score beta) {
   }
 
   //Get moves
-  std::vector<Move> moves = t.board.GetMoves<kQuiescent>();
+  MoveList moves = t.board.GetMoves<kQuiescent>();
 
   if (moves.size() == 0) {
     if (in_check) {
@@ -690,16 +846,31 @@ Score QuiescentSearch(Thread &t, Score alpha, const Score beta) {
     //SortMovesML(moves, board, 0);
   }
   
+  //Most nodes cut off on their first capture, so moves are checked with the early exit
+  //SEE until one has been searched. Only then are the exchange values of all moves
+  //computed in one pass, sharing attackers of each square.
+  std::array<NScore, kMaxNumMoves> see_values;
+  bool see_values_computed = false;
+  bool searched_move = false;
+
   //Move loop
-  for (Move move : moves) {
+  for (size_t i = 0; i < moves.size(); ++i) {
+    const Move move = moves[i];
     //SEE pruning
     //Exception for checking moves: -16.03 +/- 10.81
-    if (!in_check && GetMoveType(move) != kEnPassant && !t.board.NonNegativeSEE(move)) {
-      continue;
+    if (!in_check && GetMoveType(move) != kEnPassant) {
+      if (searched_move && !see_values_computed) {
+        t.board.SEE(moves, see_values.data());
+        see_values_computed = true;
+      }
+      if (see_values_computed ? see_values[i] < 0 : !t.board.NonNegativeSEE(move)) {
+        continue;
+      }
     }
+    searched_move = true;
 
     //Make move, search and unmake
-    t.board.Make(move);
+    MakeAndPrefetch(t, move);
     Score score = -QuiescentSearch(t, -beta, -alpha);
     t.board.UnMake();
 
@@ -744,10 +915,10 @@ Score sample_node_and_return_alpha(const Board &board, const Depth depth,
 #endif
 
 std::pair<bool, Score> move_is_singular(Thread &t, const Depth depth,
-                                       const std::vector<Move> &moves,
+                                       const MoveList &moves,
                                        const table::Entry &entry);
 
-void update_counter_move_history(Thread &t, const std::vector<Move> &quiets, const Depth depth) {
+void update_counter_move_history(Thread &t, const MoveList &quiets, const Depth depth) {
   if (t.board.get_num_made_moves() == 0 || t.board.get_last_move() == kNullMove) {
     return;
   }
@@ -813,29 +984,39 @@ Score AlphaBeta(Thread &t, Score alpha, const Score beta, Depth depth) {
   assert(beta > alpha);
   assert(beta.value() == get_next_score(alpha).value() || node_type != NodeType::kNW);
 
-  const Score original_alpha = alpha;
-
   //Immediately return 0 if we detect a draw.
   if (t.board.IsDraw() || (settings::kRepsForDraw == 3 && t.board.CountRepetitions(min_ply) >= 2)) {
-    t.nodes++;
+    t.count_node();
     if (t.board.IsFiftyMoveDraw() && t.board.InCheck() && t.board.GetMoves<kNonQuiescent>().empty()) {
       return GetMatedOnMoveScore(t.board.get_num_made_moves());
     }
     return draw_score[t.board.get_turn()];
   }
 
+  //If we can move back to an earlier position we can at least claim a draw.
+  if (settings::kRepsForDraw == 2 && alpha < draw_score[t.board.get_turn()]
+      && t.board.HasUpcomingRepetition()) {
+    alpha = draw_score[t.board.get_turn()];
+    if (alpha >= beta) {
+      t.count_node();
+      return alpha;
+    }
+  }
+
+  const Score original_alpha = alpha;
+
   //We drop to QSearch if we run out of depth.
   if (depth <= 0) {
     if (!settings::kUseQS) {
-      t.nodes++;
-      return net_evaluation::ScoreBoard(t.board);
+      t.count_node();
+      return net_evaluation::ScoreBoard(t.board, t.pawn_hash);
     }
     return QuiescentSearch(t, alpha, beta);
   }
 
   // To avoid counting nodes twice if all we do is fall through to QSearch,
   // we wait until here to count this node.
-  t.nodes++;
+  t.count_node();
 
   //Transposition Table Probe
   table::Entry entry = table::GetEntry(t.board.get_hash());
@@ -862,7 +1043,7 @@ Score AlphaBeta(Thread &t, Score alpha, const Score beta, Depth depth) {
         static_eval = entry.get_score(t.board);
       }
       else {
-        static_eval = net_evaluation::ScoreBoard(t.board);
+        static_eval = net_evaluation::ScoreBoard(t.board, t.pawn_hash);
         if ( (entry.get_bound() == kLowerBound && static_eval < entry.get_score(t.board))
             || (entry.get_bound() == kUpperBound && static_eval > entry.get_score(t.board)) ) {
           static_eval = entry.get_score(t.board);
@@ -870,7 +1051,7 @@ Score AlphaBeta(Thread &t, Score alpha, const Score beta, Depth depth) {
       }
     }
     else {
-      static_eval = net_evaluation::ScoreBoard(t.board);
+      static_eval = net_evaluation::ScoreBoard(t.board, t.pawn_hash);
     }
     t.set_static_score(static_eval);
     strict_worsening = t.strict_worsening();
@@ -887,7 +1068,7 @@ Score AlphaBeta(Thread &t, Score alpha, const Score beta, Depth depth) {
     //Null Move Pruning
     if (static_eval >= beta && is_null_move_allowed(t.board, depth)) {
       t.set_move(kNullMove);
-      t.board.Make(kNullMove);
+      t.board.MakeNullMove();
       const Depth R = 3 + depth / 5;
       Score score = -AlphaBeta<NodeType::kNW>(t, -beta, -alpha,
                                     depth - R);
@@ -904,32 +1085,20 @@ Score AlphaBeta(Thread &t, Score alpha, const Score beta, Depth depth) {
     depth--;
   }
 
-  //Get move list and return result if there are no legal moves
-  std::vector<Move> moves = t.board.GetMoves<kNonQuiescent>();
-  if (moves.size() == 0) {
-    if (in_check) {
-      return GetMatedOnMoveScore(t.board.get_num_made_moves());
-    }
-    return draw_score[t.board.get_turn()];
-  }
-
   Move tt_entry = kNullMove;
   if (valid_entry) {
     tt_entry = entry.get_best_move();
   }
 
-  bool moves_sorted = false, swapped = false;
-  if (tt_entry != kNullMove) {
-    swapped = SwapToFront(moves, tt_entry);
-    assert(!swapped || tt_entry == moves[0]);
-  }
-  if (!swapped) {
-    SortMovesML(moves, t, tt_entry);
-    moves_sorted = true;
-  }
+  //Moves are only generated once the TT move fails to produce a cutoff.
+  MovePicker picker(t, tt_entry, in_check);
 
   Move best_local_move = tt_entry;
-  if (node_type == NodeType::kPV && moves.size() == 1) {
+  //Single reply extension. Outside of check a single legal move is too rare to
+  //justify generating all moves before the TT move has been tried.
+  const bool single_reply = node_type == NodeType::kPV && in_check
+                         && picker.get_moves().size() == 1;
+  if (single_reply) {
     depth++;
   }
 
@@ -939,27 +1108,22 @@ Score AlphaBeta(Thread &t, Score alpha, const Score beta, Depth depth) {
   Vec<BitBoard, 6> checking_squares = t.board.GetDirectCheckingSquares();
 
   Score lower_bound_score = GetMatedOnMoveScore(t.board.get_num_made_moves());
-  std::vector<Move> quiets;
+  MoveList quiets;
   Score alpha_nw = alpha.get_next_score();
   //Move loop
-  for (size_t i = 0; i < moves.size(); ++i) {
-    if (i == 1 && !moves_sorted) {
-      SortMovesML(moves, t, tt_entry);
-      moves_sorted = true;
-    }
-    const Move move = moves[i];
-
+  size_t i = 0;
+  for (Move move = picker.next(); move != kNullMove; move = picker.next(), ++i) {
     Depth e = 0;// Extensions
-    if (i == 0 
+    if (i == 0 && move == tt_entry
         && depth >= settings::kSingularExtensionDepth-2
         && valid_entry
-        && entry.depth >= std::max(depth, settings::kSingularExtensionDepth) - 3
-        && !(node_type == NodeType::kPV && moves.size() == 1)
+        && entry.get_depth() >= std::max(depth, settings::kSingularExtensionDepth) - 3
         && entry.get_bound() != kUpperBound
         && entry.get_score(t.board).is_static_eval()
-        && get_singular_beta(entry.get_score(t.board), depth) > kMinStaticEval) {
+        && get_singular_beta(entry.get_score(t.board), depth) > kMinStaticEval
+        && !single_reply) {
+      MoveList moves = picker.get_moves();
       SortMovesML(moves, t, tt_entry);
-      moves_sorted = true;
       auto is_singular = move_is_singular(t, depth, moves, entry);
       if (is_singular.first) {
         e = 1;
@@ -999,7 +1163,7 @@ Score AlphaBeta(Thread &t, Score alpha, const Score beta, Depth depth) {
 
     //Make moves, search and unmake
     t.set_move(move);
-    t.board.Make(move);
+    MakeAndPrefetch(t, move);
     Score score;
     if (i == 0) {
       //First move gets searched at full depth and window
@@ -1065,6 +1229,15 @@ Score AlphaBeta(Thread &t, Score alpha, const Score beta, Depth depth) {
       lower_bound_score = score;
     }
   }
+
+  //Return result if there are no legal moves
+  if (i == 0) {
+    if (in_check) {
+      return GetMatedOnMoveScore(t.board.get_num_made_moves());
+    }
+    return draw_score[t.board.get_turn()];
+  }
+
   if (node_type != NodeType::kNW && alpha > original_alpha) {
     assert(best_local_move != kNullMove);
     // We should save any best move which has improved alpha.
@@ -1078,7 +1251,7 @@ Score AlphaBeta(Thread &t, Score alpha, const Score beta, Depth depth) {
 }
 
 std::pair<bool, Score> move_is_singular(Thread &t, const Depth depth,
-                                       const std::vector<Move> &moves,
+                                       const MoveList &moves,
                                        const table::Entry &entry) {
   const Score beta = entry.get_score(t.board);
   const Score rBeta = get_singular_beta(beta, depth);
@@ -1103,7 +1276,7 @@ std::pair<bool, Score> move_is_singular(Thread &t, const Depth depth,
 }
 
 Score RootSearchLoop(Thread &t, Score original_alpha, const Score beta,
-                     Depth current_depth, std::vector<Move> &moves) {
+                     Depth current_depth, MoveList &moves) {
   assert(original_alpha.is_valid());
   assert(beta.is_valid());
   assert(original_alpha < beta);
@@ -1111,7 +1284,7 @@ Score RootSearchLoop(Thread &t, Score original_alpha, const Score beta,
   Score alpha = original_alpha;
   Score lower_bound_score = kMinScore;
   //const bool in_check = board.InCheck();
-  if (settings::kRepsForDraw == 3 && alpha < draw_score[t.board.get_turn()].get_previous_score() && t.board.MoveInListCanRepeat(moves)) {
+  if (settings::kRepsForDraw == 3 && alpha < draw_score[t.board.get_turn()].get_previous_score() && t.board.HasUpcomingRepetition()) {
     if (beta <= draw_score[t.board.get_turn()]) {
       return draw_score[t.board.get_turn()];
     }
@@ -1158,14 +1331,12 @@ Score RootSearchLoop(Thread &t, Score original_alpha, const Score beta,
         return lower_bound_score;
       }
       if (score >= beta) {
-        auto it = moves.rbegin() + moves.size() - i - 1;
-        std::rotate(it, it + 1, moves.rend());
+        std::rotate(moves.begin(), moves.begin() + i, moves.begin() + i + 1);
         return score;
       }
       else if (score > alpha) {
         alpha = score;
-        auto it = moves.rbegin() + moves.size() - i - 1;
-        std::rotate(it, it + 1, moves.rend());
+        std::rotate(moves.begin(), moves.begin() + i, moves.begin() + i + 1);
       }
     }
   }
@@ -1176,7 +1347,7 @@ Score RootSearchLoop(Thread &t, Score original_alpha, const Score beta,
   return lower_bound_score;
 }
 
-inline Score PVS(Thread &t, Depth current_depth, const std::vector<Score> &previous_scores, std::vector<Move> &moves) {
+inline Score PVS(Thread &t, Depth current_depth, const std::vector<Score> &previous_scores, MoveList &moves) {
   if (current_depth <= 4) {
     return RootSearchLoop(t, kMinScore, kMaxScore, current_depth, moves);
   }
@@ -1225,6 +1396,8 @@ void PrintUCIInfoString(Thread &t, const Depth depth, const Time &begin,
                         const Time &end, const Score &score, const Move best_move) {
   std::vector<Move> pv;
   build_pv(t.board, pv, best_move);
+  //Helper counts lag by at most one flush interval each, which is fine for info lines.
+  t.flush_counters();
   size_t node_count = Threads.get_node_count();
   auto time_used = std::chrono::duration_cast<Milliseconds>(end-begin);
   if (print_info) {
@@ -1274,7 +1447,7 @@ void Thread::search() {
     end_time = begin+rsearch_duration;
   }
 
-  Score score = net_evaluation::ScoreBoard(board);
+  Score score = net_evaluation::ScoreBoard(board, pawn_hash);
   set_static_score(score);
   Move last_best = kNullMove;
   std::vector<Score> previous_scores;
@@ -1286,23 +1459,21 @@ void Thread::search() {
     }
 
     if (id != 0 && depth > 4) {
-      static std::mutex mutex;
-      std::lock_guard<std::mutex> lock(mutex);
-
-      size_t count = 0;
-      for (Thread* t : Threads.helpers) {
-        if (depth <= t->current_depth) {
-          count++;
-        }
-      }
-      if (count >= Threads.get_thread_count() / 2) {
-        if ((id % 3) != (depth % 3)) {
+      const int32_t count = Threads.depth_counts[depth].load(std::memory_order_relaxed);
+      if (count >= static_cast<int32_t>(Threads.get_thread_count() / 2)) {
+        const int32_t period = Threads.depth_skip_period.load(std::memory_order_relaxed);
+        if ((id % period) != (depth % period)) {
           continue;
         }
         depth = std::min(depth+1, rsearch_depth);
       }
     }
 
+    if (id != 0) {
+      for (Depth d = current_depth + 1; d <= depth; ++d) {
+        Threads.depth_counts[d].fetch_add(1, std::memory_order_relaxed);
+      }
+    }
     current_depth = depth;
 
     score = PVS(*this, current_depth, previous_scores, moves);
@@ -1351,7 +1522,7 @@ Move RootSearch(Board &board, Depth depth, Milliseconds duration = Milliseconds(
   Threads.reset_depths();
   rsearch_depth = std::min(depth, settings::kMaxDepth);
   rsearch_duration = duration;
-  std::vector<Move> moves = board.GetMoves<kNonQuiescent>();
+  MoveList moves = board.GetMoves<kNonQuiescent>();
   assert(moves.size() != 0);
   if (moves.size() == 1 && !fixed_search_time) {
     return moves[0];
@@ -1363,11 +1534,10 @@ Move RootSearch(Board &board, Depth depth, Milliseconds duration = Milliseconds(
   }
   Threads.main_thread->board.SetToSamePosition(board);
   Threads.main_thread->root_height = board.get_num_made_moves();
-  Threads.main_thread->max_depth = board.get_num_made_moves();
+  Threads.main_thread->set_max_depth(board.get_num_made_moves());
   SortMovesML(moves, *Threads.main_thread, tt_move);
   Threads.main_thread->moves = moves;
   Threads.end_search = false;
-  std::vector<std::thread> helpers;
   for (Thread* t : Threads.helpers) {
     t->board.SetToSamePosition(board);
     t->root_height = board.get_num_made_moves();
@@ -1376,14 +1546,16 @@ Move RootSearch(Board &board, Depth depth, Milliseconds duration = Milliseconds(
     while(rng() % 2) {
       t->perturb_root_moves();
     }
-    t->max_depth = t->board.get_num_made_moves();
-    helpers.emplace_back(std::thread(&Thread::search, t));
+    t->set_max_depth(t->board.get_num_made_moves());
+    t->worker.run([t]() { t->search(); });
   }
   Threads.main_thread->search();
   Threads.end_search = true;
-  for (size_t helper_idx = 0; helper_idx < Threads.helpers.size(); ++helper_idx) {
-    helpers[helper_idx].join();
+  for (Thread* t : Threads.helpers) {
+    t->worker.wait();
+    t->flush_counters();
   }
+  Threads.main_thread->flush_counters();
   return Threads.main_thread->moves[0];
 }
 
@@ -1479,7 +1651,7 @@ void TrainSearchParams(bool from_scratch) {
       continue;
     }
     end_time = get_infinite_time();
-    std::vector<Move> moves = sampled_board.GetMoves<kNonQuiescent>();
+    MoveList moves = sampled_board.GetMoves<kNonQuiescent>();
     std::shuffle(moves.begin(), moves.end(), rng);
     Threads.main_thread->board.SetToSamePosition(sampled_board);
     SortMovesML(moves, *Threads.main_thread, kNullMove);
@@ -1700,7 +1872,7 @@ void CreateSearchParamDataset() {
       continue;
     }
     end_time = get_infinite_time();
-    std::vector<Move> moves = sampled_board.GetMoves<kNonQuiescent>();
+    MoveList moves = sampled_board.GetMoves<kNonQuiescent>();
     if (moves.size() <= 1) {
       continue;
     }
@@ -1947,7 +2119,7 @@ void EvaluateScoreDistributions(const int focus) {
       }
     }
     else if (focus == 1) {
-      std::vector<Move> moves = sampled_board.GetMoves<kNonQuiescent>();
+      MoveList moves = sampled_board.GetMoves<kNonQuiescent>();
       for (Depth depth = 1; depth <= max_depth; ++depth) {
         for (Move move : moves) {
           if (GetMoveType(move) >= kEnPassant) {
@@ -1978,7 +2150,7 @@ void EvaluateScoreDistributions(const int focus) {
       }
     }
     else if (focus == 2) {
-      std::vector<Move> moves = sampled_board.GetMoves<kNonQuiescent>();
+      MoveList moves = sampled_board.GetMoves<kNonQuiescent>();
       for (Depth depth = 1; depth <= max_depth; ++depth) {
         NScore max_dif = kMinScore.to_nscore();
         NScore max_forcing_dif = kMinScore.to_nscore();
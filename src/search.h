@@ -36,7 +36,6 @@
 
 namespace search {
 
-size_t Perft(Board &board, Depth depth);
 Move DepthSearch(Board board, Depth depth);
 Move TimeSearch(Board board, Milliseconds time);
 Move FixedTimeSearch(Board board, Milliseconds time);
@@ -49,7 +48,7 @@ size_t get_num_nodes();
 void set_print_info(bool print_info);
 void end_search();
 Board get_sampled_board();
-std::vector<Move> GetSortedMovesML(Board &board);
+MoveList GetSortedMovesML(Board &board);
 
 std::vector<Board> GenerateEvalSampleSet(std::string filename);
 
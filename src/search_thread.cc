@@ -26,24 +26,110 @@
  */
 
 #include "search_thread.h"
+#include "transposition.h"
 #include "general/types.h"
+#include "general/numa.h"
+#include <cstdint>
+#include <cstdlib>
+#include <new>
 #include <random>
 #include <algorithm>
 #include <iostream>
 
 namespace {
 std::mt19937_64 rng;
+
+//With NUMA binding enabled the thread is allocated from a temporary OS thread bound to
+//its node. This way its tables are first touched on the local node and the worker thread
+//started by the constructor inherits the affinity.
+search::Thread* NewThread(const size_t id) {
+  search::Thread *thread = nullptr;
+  if (numa::IsEnabled()) {
+    std::thread([&thread, id]() {
+      numa::BindThisThread(id);
+      thread = new search::Thread();
+    }).join();
+  }
+  else {
+    thread = new search::Thread();
+  }
+  thread->id = id;
+  return thread;
+}
 }
 
 namespace search {
 
 ThreadPool Threads;
 
+Worker::Worker() : busy(false), exit(false), thread(&Worker::loop, this) {}
+
+Worker::~Worker() {
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.wait(lock, [this]{ return !busy; });
+    exit = true;
+  }
+  cv.notify_all();
+  thread.join();
+}
+
+void Worker::run(std::function<void()> new_task) {
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.wait(lock, [this]{ return !busy; });
+    task = std::move(new_task);
+    busy = true;
+  }
+  cv.notify_all();
+}
+
+void Worker::wait() {
+  std::unique_lock<std::mutex> lock(mutex);
+  cv.wait(lock, [this]{ return !busy; });
+}
+
+void Worker::loop() {
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true) {
+    cv.wait(lock, [this]{ return busy || exit; });
+    if (exit) {
+      return;
+    }
+    lock.unlock();
+    task();
+    lock.lock();
+    busy = false;
+    cv.notify_all();
+  }
+}
+
 Thread::Thread() {
   id = 1;//This should be immediately set to something else. It is set here only to guarantee non-zero for helpers.
+  reset_node_count();
+  set_max_depth(0);
   clear_killers_and_counter_moves();
 }
 
+void* Thread::operator new(size_t size) {
+  //The address returned by malloc is stored right before the aligned object.
+  constexpr size_t alignment = alignof(Thread);
+  void *memory = std::malloc(size + alignment + sizeof(void*));
+  if (memory == nullptr) {
+    throw std::bad_alloc();
+  }
+  const uintptr_t start = reinterpret_cast<uintptr_t>(memory) + sizeof(void*);
+  void **aligned = reinterpret_cast<void**>((start + alignment - 1) & ~(alignment - 1));
+  aligned[-1] = memory;
+  return aligned;
+}
+
+void Thread::operator delete(void *memory) {
+  if (memory != nullptr) {
+    std::free(static_cast<void**>(memory)[-1]);
+  }
+}
+
 void Thread::perturb_root_moves() {
   for (int i = moves.size()-1; i > 0; i--) {
     if (rng() % 2) {
@@ -166,9 +252,23 @@ int32_t Thread::get_continuation_score(const Move move) const {
 }
 
 ThreadPool::ThreadPool() {
-  main_thread = new Thread();
-  main_thread->id = 0;
+  main_thread = NewThread(0);
   is_searching = false;
+  depth_skip_period = 3;
+  reset_depths();
+}
+
+ThreadPool::~ThreadPool() {
+  set_num_threads(1);
+  delete main_thread;
+}
+
+void ThreadPool::start_main(std::function<void()> task) {
+  main_thread->worker.run(std::move(task));
+}
+
+void ThreadPool::wait_main() {
+  main_thread->worker.wait();
 }
 
 void ThreadPool::set_num_threads(size_t num_threads) {
@@ -177,8 +277,7 @@ void ThreadPool::set_num_threads(size_t num_threads) {
 
   //Create new threads if we have too few
   while(helpers.size() < num_helpers) {
-    helpers.push_back(new Thread());
-    helpers.back()->id = helpers.size();
+    helpers.push_back(NewThread(helpers.size() + 1));
   }
 
   //Kill helper threads if we have too many
@@ -188,6 +287,33 @@ void ThreadPool::set_num_threads(size_t num_threads) {
   }
 }
 
+void ThreadPool::reallocate_threads() {
+  wait_main();
+  const size_t num_threads = get_thread_count();
+  set_num_threads(1);
+  delete main_thread;
+  main_thread = NewThread(0);
+  set_num_threads(num_threads);
+}
+
+void ThreadPool::run_on_all(const std::function<void(size_t, size_t)> &task) {
+  const size_t count = get_thread_count();
+  for (size_t i = 0; i < helpers.size(); ++i) {
+    helpers[i]->worker.run([&task, i, count]() { task(i + 1, count); });
+  }
+  //Slice 0 belongs to the main thread, so it runs on its worker unless we already are there.
+  if (main_thread->worker.is_current()) {
+    task(0, count);
+  }
+  else {
+    main_thread->worker.run([&task, count]() { task(0, count); });
+    main_thread->worker.wait();
+  }
+  for (Thread* helper : helpers) {
+    helper->worker.wait();
+  }
+}
+
 void ThreadPool::clear_killers_and_countermoves() {
   for (Thread* thread : helpers) {
     thread->clear_killers_and_counter_moves();
@@ -200,33 +326,42 @@ void ThreadPool::reset_depths() {
     thread->current_depth = 1;
   }
   main_thread->current_depth = 1;
+  for (Depth depth = 0; depth < static_cast<Depth>(depth_counts.size()); ++depth) {
+    depth_counts[depth] = depth <= 1 ? helpers.size() : 0;
+  }
 }
 
 size_t ThreadPool::get_thread_count() const {
   return helpers.size() + 1;
 }
+size_t ThreadPool::get_node_count_from_main() const {
+  size_t sum = main_thread->get_local_node_count();
+  for (Thread* helper : helpers) {
+    sum += helper->get_node_count();
+  }
+  return sum;
+}
+
 size_t ThreadPool::get_node_count() const {
-  size_t sum = main_thread->nodes;
+  size_t sum = main_thread->get_node_count();
   for (Thread* helper : helpers) {
-    sum += helper->nodes;
+    sum += helper->get_node_count();
   }
   return sum;
 }
 
 size_t ThreadPool::get_max_depth() const {
-  size_t max_d = main_thread->max_depth;
+  size_t max_d = main_thread->get_max_depth();
   for (Thread* helper : helpers) {
-    if (helper->max_depth > max_d) {
-      max_d = helper->max_depth;
-    }
+    max_d = std::max(max_d, helper->get_max_depth());
   }
   return max_d;
 }
 
 void ThreadPool::reset_node_count() {
-  main_thread->nodes = 0;
+  main_thread->reset_node_count();
   for (Thread* helper : helpers) {
-    helper->nodes = 0;
+    helper->reset_node_count();
   }
 }
 
@@ -243,5 +378,21 @@ template void Thread::update_continuation_score<2>(const PieceType opp_piecetype
 
 
 void SetNumThreads(int32_t value) { Threads.set_num_threads(value); }
+void SetDepthSkipPeriod(int32_t value) { Threads.depth_skip_period = value; }
+void SetPawnHashSize(int32_t MB) {
+  const size_t bytes = static_cast<size_t>(MB) << 20;
+  net_evaluation::SetPawnHashSize(bytes);
+  //Each thread resizes its own table, so it is the first to touch the memory.
+  Threads.run_on_all([bytes](const size_t idx, const size_t count) {
+    Thread *thread = idx == 0 ? Threads.main_thread : Threads.helpers[idx - 1];
+    thread->pawn_hash.resize(bytes);
+  });
+}
+
+void SetNUMA(bool value) {
+  numa::SetEnabled(value);
+  Threads.reallocate_threads();
+  table::DistributeTable();
+}
 
 }
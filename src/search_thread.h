@@ -29,9 +29,13 @@
 #define SRC_SEARCH_THREAD_H_
 
 #include "board.h"
+#include "net_evaluation.h"
 #include "general/types.h"
 #include "general/settings.h"
 #include <array>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
 #include <thread>
 #include <vector>
 #include <atomic>
@@ -43,6 +47,29 @@ struct PieceTypeAndDestination {
   Square des;
 };
 
+//Long lived OS thread which sleeps on a condition variable until it is handed a task.
+class Worker {
+public:
+  Worker();
+  ~Worker();
+  //Waits until the previous task has finished and starts task.
+  void run(std::function<void()> task);
+  //Blocks until the current task has finished.
+  void wait();
+  //Returns true if called from this worker's thread.
+  bool is_current() const { return std::this_thread::get_id() == thread.get_id(); }
+
+private:
+  void loop();
+
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::function<void()> task;
+  bool busy;
+  bool exit;
+  std::thread thread;
+};
+
 struct Thread {
   Thread();
 
@@ -122,7 +149,7 @@ struct Thread {
 
   //Data for search local to the thread
   Board board;
-  std::vector<Move> moves;
+  MoveList moves;
   Depth current_depth;
   Array2d<Move, 1024, 2> killers;
   Array3d<Move, 2, 6, 64> counter_moves;
@@ -131,25 +158,89 @@ struct Thread {
   std::array<PieceTypeAndDestination, settings::kMaxDepth> passed_moves;
   Depth root_height;
   std::array<Score, settings::kMaxDepth> static_scores;
-  std::atomic<size_t> nodes;
-  std::atomic<size_t> max_depth;
+  net_evaluation::PawnHash pawn_hash;
+  //Threads are over-aligned because of the shared counters below, which operator new
+  //only respects from C++17 on.
+  static void* operator new(size_t size);
+  static void operator delete(void *memory);
+
+  //Node and seldepth counters are only written by the owning thread. They are
+  //published to the shared atomics every kCounterFlushInterval nodes, so the hot
+  //path has no atomic read-modify-writes. Other threads therefore see counts which
+  //lag by up to kCounterFlushInterval nodes per thread.
+  void count_node() {
+    if ((++nodes & (kCounterFlushInterval - 1)) == 0) {
+      flush_counters();
+    }
+  }
+  void update_max_depth(const size_t depth) {
+    if (max_depth < depth) {
+      max_depth = depth;
+    }
+  }
+  void set_max_depth(const size_t depth) {
+    max_depth = depth;
+    shared_max_depth.store(depth, std::memory_order_relaxed);
+  }
+  void reset_node_count() {
+    nodes = 0;
+    shared_nodes.store(0, std::memory_order_relaxed);
+  }
+  void flush_counters() {
+    shared_nodes.store(nodes, std::memory_order_relaxed);
+    shared_max_depth.store(max_depth, std::memory_order_relaxed);
+  }
+  size_t get_node_count() const { return shared_nodes.load(std::memory_order_relaxed); }
+  //Exact count, only valid when called from the owning thread.
+  size_t get_local_node_count() const { return nodes; }
+  size_t get_max_depth() const { return shared_max_depth.load(std::memory_order_relaxed); }
+
+  //OS thread this search thread runs on.
+  Worker worker;
+
+private:
+  static constexpr size_t kCounterFlushInterval = 1024;
+  size_t nodes;
+  size_t max_depth;
+  //Keeps the counters read by other threads off the cache lines written on every node.
+  //They come last, so the object ends on the same line.
+  alignas(64) std::atomic<size_t> shared_nodes;
+  std::atomic<size_t> shared_max_depth;
 };
 
 struct ThreadPool {
   ThreadPool();
+  ~ThreadPool();
   //Set number of threads including main thread
   void set_num_threads(size_t num_threads);
+  //Recreates all threads, eg to apply a changed NUMA binding. Must not be called during search.
+  void reallocate_threads();
+  //Runs task(idx, count) once for every thread on that thread's worker, where count is the
+  //number of threads. Returns when all are done.
+  void run_on_all(const std::function<void(size_t, size_t)> &task);
   void clear_killers_and_countermoves();
   void reset_depths();
 
   size_t get_thread_count() const;
   size_t get_node_count() const;
+  //Node count as seen from the main thread, its own nodes are counted exactly.
+  size_t get_node_count_from_main() const;
 
   size_t get_max_depth() const;
   void reset_node_count();
 
+  //Runs task, which is expected to start a search, on the main thread's worker.
+  void start_main(std::function<void()> task);
+  //Blocks until the task started on the main thread's worker has finished.
+  void wait_main();
+
   bool is_searching;
   std::atomic_bool end_search;
+  //Number of helpers which have reached at least each root depth. Helpers use this to
+  //spread out over depths without synchronizing with each other.
+  std::array<std::atomic<int32_t>, settings::kMaxDepth + 1> depth_counts;
+  //A helper searches a crowded depth only if its id matches the depth modulo this period.
+  std::atomic<int32_t> depth_skip_period;
   std::vector<Thread*> helpers;
   Thread* main_thread;
 };
@@ -158,6 +249,11 @@ struct ThreadPool {
 extern ThreadPool Threads;
 
 void SetNumThreads(int32_t value);
+void SetDepthSkipPeriod(int32_t value);
+//Binds search threads round robin to NUMA nodes and interleaves the TT over them.
+void SetNUMA(bool value);
+//Sets the size of the pawn hash of each search thread.
+void SetPawnHashSize(int32_t MB);
 
 }
 
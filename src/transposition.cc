@@ -25,8 +25,20 @@
  */
 
 #include "transposition.h"
-#include "net_evaluation.h"
+#include "search_thread.h"
+#include "general/large_pages.h"
+#include "general/numa.h"
+#include <array>
 #include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <limits>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
 
 namespace {
 
@@ -56,53 +68,124 @@ namespace table {
 
 // In addition to the main table, a second, smaller table is used for improved PV entry redundancy.
 // PV entries are stored in both and TT size is sum of size of main table and PV table.
-size_t size = 1600000;
+
+// Entries of the main table are grouped in buckets of one cache line each. A position
+// may only be stored in the bucket its hash maps to. The bucket is selected by the upper
+// bits of the hash, while entries store a key of the lower 16 bits.
+struct alignas(64) Bucket {
+  static constexpr size_t kNumEntries = 6;
+  std::array<Entry, kNumEntries> entries;
+};
+static_assert(sizeof(Bucket) == 64, "TT buckets should fill exactly one cache line.");
+
+size_t num_buckets = 400000;
 size_t size_pvt = 10001;
-std::vector<Entry> table(size);
-std::vector<Entry> table_pv(size_pvt);
+large_pages::Array<Bucket> table(num_buckets);
+large_pages::Array<Entry> table_pv(size_pvt);
 
 uint8_t current_generation = 0;
 
+bool use_shared_memory = false;
+int32_t table_megabytes = 32;
+
+// Maps both tables from POSIX shared memory. Processes with the same hash size and keys
+// end up sharing one table, which is safe as entries are validated against torn writes.
+bool MapSharedTables() {
+  std::ostringstream name;
+  name << "/winter_tt_" << std::hex << Board::GetZobristFingerprint() << std::dec
+       << "_" << table_megabytes;
+  large_pages::Allocation main_allocation = large_pages::MapShared(
+      name.str() + "_main", num_buckets * sizeof(Bucket));
+  large_pages::Allocation pv_allocation = large_pages::MapShared(
+      name.str() + "_pv", size_pvt * sizeof(Entry));
+  if (main_allocation.memory == nullptr || pv_allocation.memory == nullptr) {
+    large_pages::Free(main_allocation);
+    large_pages::Free(pv_allocation);
+    return false;
+  }
+  table.adopt(std::move(main_allocation), num_buckets);
+  table_pv.adopt(std::move(pv_allocation), size_pvt);
+  return true;
+}
+
 void UpdateGeneration() {
   current_generation += (0x1 << 2);
 }
 
 void SetTableSize(const int32_t MB_total_int) {
+  table_megabytes = MB_total_int;
   const size_t MB_total = static_cast<size_t>(MB_total_int);
-  const size_t bytes_total = MB_total << 20;
-  const size_t bytes_p_hash = bytes_total / 8;
-  const size_t bytes = bytes_total - bytes_p_hash;
-  net_evaluation::SetPHashSize(bytes_p_hash);
-  size = (6 * (bytes >> 4)) / 7;
-  size_pvt = size / 6;
-
-  size -= size % 4;
+  const size_t bytes = MB_total << 20;
+  // The PV table gets a seventh of the memory, as before entries were compressed.
+  num_buckets = ((6 * bytes) / 7) / sizeof(Bucket);
+  size_pvt = (bytes / 7) / sizeof(Entry);
+
+  // Shared tables are zeroed on creation and must not be cleared, as other processes
+  // may already be using them.
+  if (use_shared_memory) {
+    if (MapSharedTables()) {
+      DistributeTable();
+      return;
+    }
+    std::cout << "info string Failed to map shared hash, using private memory" << std::endl;
+  }
 
-  table.resize(size);
+  // The new memory is not touched until it is cleared, which happens in parallel so each
+  // search thread faults in its own slice.
+  table.resize(num_buckets);
   table_pv.resize(size_pvt);
+  DistributeTable();
+  ClearTable();
 }
 
-size_t HashFunction(const HashType hash) {
-  return (hash % size) & ~(0x3);
+std::string GetTableDescription() {
+  const bool shared = !table.get_allocation().shared_name.empty();
+  return std::to_string(table_megabytes) + (shared ? " MB shared using " : " MB using ")
+      + large_pages::Describe(table.get_allocation());
 }
 
-size_t PVHashFunction(const HashType hash) {
-  return hash % size_pvt;
+void SetSharedMemory(const bool value) {
+  use_shared_memory = value;
+  SetTableSize(table_megabytes);
 }
 
-Entry GetMainEntryIdx(const HashType hash) {
-  size_t idx = HashFunction(hash);
-  for (size_t i = 0; i < 3; ++i) {
-    if (ValidateHash(table[idx+i], hash)) {
-      return table[idx+i];
-    }
+void DistributeTable() {
+  if (numa::IsEnabled()) {
+    numa::Interleave(table.data(), table.size() * sizeof(Bucket));
+    numa::Interleave(table_pv.data(), table_pv.size() * sizeof(Entry));
   }
-  return table[idx+3];
+}
+
+// Maps the hash uniformly to [0, range) with a multiply-high, which is much cheaper
+// than a 64 bit modulo.
+inline size_t ScaleHash(const HashType hash, const size_t range) {
+  return static_cast<size_t>((static_cast<unsigned __int128>(hash) * range) >> 64);
+}
+
+inline Bucket &GetBucket(const HashType hash) {
+  return table[ScaleHash(hash, num_buckets)];
+}
+
+inline size_t PVHashFunction(const HashType hash) {
+  return ScaleHash(hash, size_pvt);
+}
+
+void Prefetch(const HashType hash) {
+  __builtin_prefetch(&GetBucket(hash));
 }
 
 Entry GetEntry(const HashType hash) {
-  Entry entry = GetMainEntryIdx(hash);
-  Entry entry_pv = table_pv.at(PVHashFunction(hash));
+  const Bucket &bucket = GetBucket(hash);
+  // Entries are copied before validation, as other threads may overwrite them at any time.
+  Entry entry = bucket.entries[Bucket::kNumEntries - 1];
+  for (size_t i = 0; i < Bucket::kNumEntries - 1; ++i) {
+    const Entry candidate = bucket.entries[i];
+    if (ValidateHash(candidate, hash)) {
+      entry = candidate;
+      break;
+    }
+  }
+  const Entry entry_pv = table_pv[PVHashFunction(hash)];
 
   if (!ValidateHash(entry, hash)) {
     return entry_pv;
@@ -110,86 +193,79 @@ Entry GetEntry(const HashType hash) {
   if (!ValidateHash(entry_pv, hash)) {
     return entry;
   }
-  if (entry.depth > entry_pv.depth) {
+  if (entry.get_depth() > entry_pv.get_depth()) {
     return entry;
   }
   return entry_pv;
 }
 
-size_t GetIdxToReplace(HashType hash) {
-  size_t idx = HashFunction(hash);
-  if (ValidateHash(table[idx], hash)) {
-    return idx;
-  }
-  int worst_score = 1024 + static_cast<int>(table[idx].depth)
-      - 512 * (table[idx].get_generation() != current_generation);
-  size_t worst_idx = idx;
-
-  for (size_t i = 1; i <= 3; ++i) {
-    if (ValidateHash(table[idx+i], hash)) {
-      return idx + i;
+Entry &GetEntryToReplace(Bucket &bucket, const HashType hash) {
+  Entry *worst_entry = &bucket.entries[0];
+  int worst_score = std::numeric_limits<int>::max();
+  for (Entry &entry : bucket.entries) {
+    if (ValidateHash(entry, hash)) {
+      return entry;
     }
-    int score = 1024 + static_cast<int>(table[idx+i].depth)
-          - 512 * (table[idx+i].get_generation() != current_generation);
+    const int score = 1024 + entry.get_depth()
+        - 512 * (entry.get_generation() != current_generation);
     if (score < worst_score) {
       worst_score = score;
-      worst_idx = idx + i;
+      worst_entry = &entry;
     }
   }
-  return worst_idx;
+  return *worst_entry;
 }
 
 void SaveEntry(const Board &board, const Move best_move, const Score score,
                const Depth depth, const uint8_t bound) {
   HashType hash = board.get_hash();
-  size_t index = GetIdxToReplace(hash); // HashFunction(hash);
-
-  assert(index < table.size());
   assert(score.is_valid());
 
-  HashType best_move_cast = best_move;
   Entry entry;
-  entry.hash = hash ^ best_move_cast;
   entry.set_score(score, board);
   entry.set_best_move(best_move);
   entry.set_gen_and_bound(bound);
   assert(entry.get_generation() == current_generation);
-  entry.depth = depth;
-  table[index] = entry;
+  entry.set_depth(depth);
+  entry.set_key(hash);
+  GetEntryToReplace(GetBucket(hash), hash) = entry;
 }
 
 void SavePVEntry(const Board &board, const Move best_move, const Score score, const Depth depth) {
   HashType hash = board.get_hash();
-  size_t index = GetIdxToReplace(hash); // HashFunction(hash);
   size_t index_pv = PVHashFunction(hash);
 
-  assert(index < table.size());
-
-  HashType best_move_cast = best_move;
   Entry entry;
-  entry.hash = hash ^ best_move_cast;
   entry.set_score(score, board);
   entry.set_best_move(best_move);
-  entry.depth = depth;
+  entry.set_depth(depth);
   entry.set_gen_and_bound(kExactBound);
-  table[index] = entry;
+  entry.set_key(hash);
+  GetEntryToReplace(GetBucket(hash), hash) = entry;
   table_pv[index_pv] = entry;
 }
 
 bool ValidateHash(const Entry &entry, const HashType hash){
-  HashType best_move_cast = entry.get_best_move();
-  return entry.hash == (hash ^ best_move_cast);
+  return entry.matches(hash);
+}
+
+// Zeroes the idx-th of count equally sized slices of array.
+template<typename T>
+void ClearSlice(large_pages::Array<T> &array, const size_t idx, const size_t count) {
+  const size_t begin = array.size() * idx / count;
+  const size_t end = array.size() * (idx + 1) / count;
+  std::memset(static_cast<void*>(array.data() + begin), 0, (end - begin) * sizeof(T));
 }
 
 void ClearTable() {
-  for (size_t i = 0; i < table.size(); i++) {
-    table[i].hash = 0;
-    table[i].set_best_move(kNullMove);
-  }
-  for (size_t i = 0; i < table_pv.size(); i++) {
-    table_pv[i].hash = 0;
-    table_pv[i].set_best_move(kNullMove);
+  // A shared table is in use by other processes as well, so it is never wiped.
+  if (!table.get_allocation().shared_name.empty()) {
+    return;
   }
+  search::Threads.run_on_all([](const size_t idx, const size_t count) {
+    ClearSlice(table, idx, count);
+    ClearSlice(table_pv, idx, count);
+  });
 }
 
 void Entry::set_score(const Score score_new, const Board &board) {
@@ -214,10 +290,196 @@ void Entry::set_gen_and_bound(uint8_t bound) {
 size_t GetHashfull() {
   size_t result = 0;
   for (size_t i = 0; i < 1000; ++i) {
-    result += (table[i].get_generation() == current_generation);
+    const Entry &entry = table[i / Bucket::kNumEntries].entries[i % Bucket::kNumEntries];
+    // Cleared slots have no bound and must not count while the generation is still 0.
+    result += (entry.get_bound() != 0 && entry.get_generation() == current_generation);
   }
   return result;
 }
 
+namespace {
+
+// Stress test entries derive all fields from their hash, so an entry that validates
+// but was mixed from several writes is detected by comparing it to its expected value.
+Entry StressTestEntry(const HashType hash, const Board &board) {
+  Entry entry;
+  const int32_t win = static_cast<int32_t>((hash >> 16) % 2000);
+  entry.set_score(WDLScore{win, win + static_cast<int32_t>((hash >> 32) % 2000)}, board);
+  entry.set_best_move(static_cast<Move>(hash >> 48));
+  entry.set_gen_and_bound(static_cast<uint8_t>(1 + (hash >> 24) % 3));
+  entry.set_depth(static_cast<Depth>((hash >> 40) % 64));
+  entry.set_key(hash);
+  return entry;
+}
+
 }
 
+bool StressTest(const size_t num_threads, const size_t operations_per_thread) {
+  // With a single bucket and PV slot every write of every thread races on the same
+  // few entries, which is the worst case for torn writes.
+  table.resize(1);
+  table_pv.resize(1);
+  num_buckets = 1;
+  size_pvt = 1;
+
+  // Keys differ in their lower 16 bits, so entries of one key never validate for another.
+  constexpr size_t kNumKeys = 64;
+  std::array<HashType, kNumKeys> keys;
+  for (size_t i = 0; i < kNumKeys; ++i) {
+    keys[i] = (((i + 1) * 0x9E3779B97F4A7C15ULL) & ~HashType(0xffff)) | i;
+  }
+  const Board board;
+  std::vector<size_t> writes(num_threads, 0), hits(num_threads, 0), errors(num_threads, 0);
+
+  auto worker = [&](const size_t id) {
+    std::mt19937_64 rng(id);
+    for (size_t i = 0; i < operations_per_thread; ++i) {
+      const HashType hash = keys[rng() % kNumKeys];
+      const Entry expected = StressTestEntry(hash, board);
+      if (rng() & 1) {
+        GetEntryToReplace(table[0], hash) = expected;
+        table_pv[0] = expected;
+        ++writes[id];
+        continue;
+      }
+      const Entry entry = GetEntry(hash);
+      if (ValidateHash(entry, hash)) {
+        ++hits[id];
+        errors[id] += entry.get_data() != expected.get_data();
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (size_t id = 1; id < num_threads; ++id) {
+    threads.emplace_back(worker, id);
+  }
+  worker(0);
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+
+  size_t num_writes = 0, num_hits = 0, num_errors = 0;
+  for (size_t id = 0; id < num_threads; ++id) {
+    num_writes += writes[id];
+    num_hits += hits[id];
+    num_errors += errors[id];
+  }
+  std::cout << "threads: " << num_threads << " writes: " << num_writes
+            << " validated reads: " << num_hits << " inconsistent: " << num_errors << std::endl;
+
+  SetTableSize(table_megabytes);
+  return num_errors == 0;
+}
+
+namespace {
+
+struct FileHeader {
+  char magic[8];
+  uint32_t format_version;
+  uint32_t bucket_size;
+  uint32_t entry_size;
+  int32_t megabytes;
+  uint8_t generation;
+  HashType zobrist_fingerprint;
+  uint64_t num_buckets;
+  uint64_t size_pvt;
+};
+
+const char kFileMagic[8] = {'W', 'i', 'n', 't', 'e', 'r', 'T', 'T'};
+// Has to be increased whenever the layout or meaning of entries changes.
+constexpr uint32_t kFileFormatVersion = 3;
+// Both tables start on a page boundary in the file, so they can be mapped directly.
+constexpr size_t kFilePageSize = 4096;
+
+size_t RoundUpToPage(const size_t bytes) {
+  return ((bytes + kFilePageSize - 1) / kFilePageSize) * kFilePageSize;
+}
+
+size_t GetPVTableOffset(const size_t buckets) {
+  return RoundUpToPage(kFilePageSize + buckets * sizeof(Bucket));
+}
+
+}
+
+bool SaveTable(const std::string &file_name) {
+  // The header is written as raw bytes, so its padding must not hold uninitialized memory.
+  FileHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, kFileMagic, sizeof(header.magic));
+  header.format_version = kFileFormatVersion;
+  header.bucket_size = sizeof(Bucket);
+  header.entry_size = sizeof(Entry);
+  header.megabytes = table_megabytes;
+  header.generation = current_generation;
+  header.zobrist_fingerprint = Board::GetZobristFingerprint();
+  header.num_buckets = num_buckets;
+  header.size_pvt = size_pvt;
+
+  // The table may be a private mapping of file_name itself, so it must not be truncated.
+  // The new file is written next to it and then renamed over it, which leaves the pages
+  // of the old file valid for as long as they stay mapped.
+  const std::string temp_name = file_name + ".tmp";
+  std::ofstream file(temp_name, std::ios::binary | std::ios::trunc);
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  file.seekp(kFilePageSize);
+  file.write(reinterpret_cast<const char*>(table.data()), num_buckets * sizeof(Bucket));
+  file.seekp(GetPVTableOffset(num_buckets));
+  file.write(reinterpret_cast<const char*>(table_pv.data()), size_pvt * sizeof(Entry));
+  file.close();
+  if (!file || std::rename(temp_name.c_str(), file_name.c_str()) != 0) {
+    std::remove(temp_name.c_str());
+    std::cout << "info string Failed to write hash to " << file_name << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool LoadTable(const std::string &file_name) {
+  std::ifstream file(file_name, std::ios::binary | std::ios::ate);
+  const std::streamoff file_size = file.tellg();
+  FileHeader header;
+  if (!file || !file.seekg(0) || !file.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+    std::cout << "info string Failed to read hash from " << file_name << std::endl;
+    return false;
+  }
+  if (std::memcmp(header.magic, kFileMagic, sizeof(header.magic)) != 0
+      || header.format_version != kFileFormatVersion
+      || header.bucket_size != sizeof(Bucket) || header.entry_size != sizeof(Entry)) {
+    std::cout << "info string " << file_name << " is not a compatible hash file" << std::endl;
+    return false;
+  }
+  if (header.zobrist_fingerprint != Board::GetZobristFingerprint()) {
+    std::cout << "info string " << file_name << " was stored with different hash keys" << std::endl;
+    return false;
+  }
+  const size_t pv_offset = GetPVTableOffset(header.num_buckets);
+  if (header.num_buckets == 0 || header.size_pvt == 0
+      || static_cast<size_t>(file_size) < pv_offset + header.size_pvt * sizeof(Entry)) {
+    std::cout << "info string " << file_name << " is truncated" << std::endl;
+    return false;
+  }
+
+  large_pages::Allocation main_allocation = large_pages::MapFile(
+      file_name, kFilePageSize, header.num_buckets * sizeof(Bucket));
+  large_pages::Allocation pv_allocation = large_pages::MapFile(
+      file_name, pv_offset, header.size_pvt * sizeof(Entry));
+  if (main_allocation.memory == nullptr || pv_allocation.memory == nullptr) {
+    large_pages::Free(main_allocation);
+    large_pages::Free(pv_allocation);
+    std::cout << "info string Failed to map " << file_name << std::endl;
+    return false;
+  }
+  num_buckets = header.num_buckets;
+  size_pvt = header.size_pvt;
+  table.adopt(std::move(main_allocation), num_buckets);
+  table_pv.adopt(std::move(pv_allocation), size_pvt);
+  table_megabytes = header.megabytes;
+  current_generation = header.generation;
+  DistributeTable();
+  std::cout << "info string Loaded " << table_megabytes << " MB of hash from "
+            << file_name << std::endl;
+  return true;
+}
+
+}
@@ -29,6 +29,9 @@
 
 #include "general/types.h"
 #include "board.h"
+#include <cstddef>
+#include <cstring>
+#include <string>
 
 namespace table {
 
@@ -58,19 +61,61 @@ struct Entry {
 
   void set_gen_and_bound(uint8_t bound);
 
-  HashType hash;         // 8 bytes
+  Depth get_depth() const {
+    return depth;
+  }
+  void set_depth(const Depth new_depth) {
+    depth = new_depth;
+  }
+
+  /// The 8 data bytes of the entry as one word.
+  HashType get_data() const {
+    static_assert(offsetof(Entry, win) == 2 && offsetof(Entry, win_draw) == 4
+                  && offsetof(Entry, best_move) == 6 && offsetof(Entry, gen_and_bound) == 8
+                  && offsetof(Entry, depth) == 9,
+                  "The data bytes of TT entries have to directly follow the key.");
+    HashType data;
+    std::memcpy(&data, &win, sizeof(data));
+    return data;
+  }
+  /// Entries are written by several threads without locks, so the stored key is the
+  /// low 16 bits of the hash XORed with the folded data word. An entry torn by
+  /// concurrent writes then fails validation instead of mixing data.
+  /// Must be called after all other fields are set.
+  void set_key(const HashType hash) {
+    key = static_cast<uint16_t>(hash ^ fold_data());
+  }
+  bool matches(const HashType hash) const {
+    return key == static_cast<uint16_t>(hash ^ fold_data()) && get_bound() != 0;
+  }
+
 private:
+  uint16_t fold_data() const {
+    const HashType data = get_data();
+    return static_cast<uint16_t>(data ^ (data >> 16) ^ (data >> 32) ^ (data >> 48));
+  }
+
+  uint16_t key;          // 2 bytes
   int16_t win;           // 2 bytes
   int16_t win_draw;      // 2 bytes
   uint16_t best_move;    // 2 bytes
   uint8_t gen_and_bound; // 1 byte
-public:
   uint8_t depth;         // 1 byte
-                         // 16 bytes total, 4 entries per cache line.
+                         // 10 bytes total, 6 entries per cache line.
 };
+static_assert(sizeof(Entry) == 10, "TT entries should be packed into 10 bytes.");
 
 void SetTableSize(const int32_t MB);
+//Backs the table by named POSIX shared memory, so local processes using the same
+//hash size share their entries.
+void SetSharedMemory(const bool value);
+//Size and kind of memory backing the table, eg "32 MB using 2MB transparent huge pages".
+std::string GetTableDescription();
+//Interleaves the table pages over all NUMA nodes if NUMA binding is enabled.
+void DistributeTable();
 Entry GetEntry(const HashType hash);
+//Starts loading the bucket of hash into the cache ahead of a GetEntry or SaveEntry.
+void Prefetch(const HashType hash);
 void SaveEntry(const Board &board, const Move best_move, const Score score,
                const Depth depth, const uint8_t bound = kLowerBound);
 void SavePVEntry(const Board &board, const Move best_move, const Score score, const Depth depth);
@@ -81,6 +126,18 @@ void ClearTable();
 
 size_t GetHashfull();
 
+//Has num_threads threads concurrently write and probe entries all mapping to one
+//bucket and checks that every entry which validates is exactly as it was written.
+//The table is reallocated at its previous size afterwards, so its entries are lost.
+bool StressTest(const size_t num_threads, const size_t operations_per_thread);
+
+//Stores the main and PV table together with a versioned header in file_name.
+bool SaveTable(const std::string &file_name);
+//Replaces both tables by the ones stored in file_name. The file is memory mapped, so
+//entries are only read from disk once they are probed. Files written with another
+//format or other zobrist keys are rejected and leave the current table untouched.
+bool LoadTable(const std::string &file_name);
+
 }
 
 #endif /* TRANSPOSITION_H_ */
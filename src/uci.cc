@@ -33,6 +33,7 @@
 #include "search.h"
 #include "transposition.h"
 #include "search_thread.h"
+#include "perft.h"
 #include <array>
 #include <cstdint>
 #include <vector>
@@ -101,9 +102,23 @@ struct UCICheck {
   }
 };
 
+//The Hash options report the memory they ended up with. This is not done by the table
+//itself, as it is also resized at startup and by tools outside of the UCI protocol.
+void SetHash(int32_t MB) {
+  table::SetTableSize(MB);
+  std::cout << "info string Hash " << table::GetTableDescription() << std::endl;
+}
+
+void SetSharedHash(bool value) {
+  table::SetSharedMemory(value);
+  std::cout << "info string Hash " << table::GetTableDescription() << std::endl;
+}
+
 std::vector<UCIOption> uci_options {
-  {"Hash", table::SetTableSize, 32, 1, 104576},
+  {"Hash", SetHash, 32, 1, 104576},
   {"Threads", search::SetNumThreads, 1, 1, 256},
+  {"PawnHash", search::SetPawnHashSize, 4, 1, 1024},
+  {"SMPDepthSkipPeriod", search::SetDepthSkipPeriod, 3, 1, 16},
   {"Contempt", search::SetContempt, 0, -100, 100},
 #ifdef TUNE
   {"AspirationDelta", search::SetInitialAspirationDelta, 40, 10, 800},
@@ -127,6 +142,8 @@ std::vector<UCIOption> uci_options {
 std::vector<UCICheck> uci_check_options {
   {"Armageddon", search::SetArmageddon, false},
   {"UCI_ShowWDL", search::SetUCIShowWDL, true},
+  {"NUMA", search::SetNUMA, false},
+  {"SharedHash", SetSharedHash, false},
 };
 
 const std::string kEngineIsReady = "readyok";
@@ -171,6 +188,13 @@ void Go(Board *board, Timer timer) {
   search::Threads.is_searching = false;
 }
 
+//Stops a running search and waits until it has finished, so the tables it uses may be
+//replaced.
+void StopSearch() {
+  search::end_search();
+  search::Threads.wait_main();
+}
+
 void Reply(std::string message) {
   std::cout << message << std::endl;
 }
@@ -188,10 +212,7 @@ void Loop() {
     std::string command = tokens[index++];
     if (Equals(command, "quit")) {
       //Resynchronise search threads:
-      search::end_search();
-      while (search::Threads.is_searching) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(1));
-      }
+      StopSearch();
       break;
     }
     else if (Equals(command, "gen_eval_csv")) {
@@ -245,6 +266,7 @@ void Loop() {
       board = Board();
     }
     else if (Equals(command, "setoption")) {
+      StopSearch();
       index++;
       command = tokens[index++];
       for (UCIOption &option : uci_options) {
@@ -265,13 +287,13 @@ void Loop() {
       }
     }
     else if (Equals(command, "print_moves")) {
-      std::vector<Move> moves = board.GetMoves<kNonQuiescent>();
+      MoveList moves = board.GetMoves<kNonQuiescent>();
       for (unsigned int i = 0; i < moves.size(); i++) {
         std::cout << parse::MoveToString(moves[i]) << std::endl;
       }
     }
     else if (Equals(command, "print_moves_sorted")) {
-      std::vector<Move> moves = search::GetSortedMovesML(board);
+      MoveList moves = search::GetSortedMovesML(board);
       for (unsigned int i = 0; i < moves.size(); i++) {
         std::cout << parse::MoveToString(moves[i]) << std::endl;
       }
@@ -299,7 +321,7 @@ void Loop() {
         if (Equals(arg, "moves")) {
           while (index < tokens.size()) {
             Move move = parse::StringToMove(tokens[index++]);
-            std::vector<Move> moves = board.GetMoves<kNonQuiescent>();
+            MoveList moves = board.GetMoves<kNonQuiescent>();
             for (unsigned int i = 0; i < moves.size(); i++) {
               if (GetMoveSource(moves[i]) == GetMoveSource(move)
                   && GetMoveDestination(moves[i]) == GetMoveDestination(move)
@@ -314,7 +336,8 @@ void Loop() {
       }
     }
     else if (Equals(command, "go")) {
-      search::end_search();
+      // A search that is still running has to finish before the next one can start.
+      StopSearch();
       Timer timer {};
       if (tokens.size() >= index+2) {
         while (tokens.size() >= index+2) {
@@ -352,8 +375,7 @@ void Loop() {
       else{
         timer.search_depth = 6;
       }
-      std::thread t(Go, &board, timer);
-      t.detach();
+      search::Threads.start_main([&board, timer]() { Go(&board, timer); });
     }
     else if (Equals(command, "see")) {
       Move move = parse::StringToMove(tokens[index]);
@@ -361,22 +383,27 @@ void Loop() {
     }
     else if (Equals(command, "perft")) {
       Depth depth = atoi(tokens[index++].c_str());
-      std::vector<Move> moves = board.GetMoves<kNonQuiescent>();
-      uint64_t sum = 0;
-      Time begin = now();
-      for (Move move : moves) {
-        board.Make(move);
-        long perft_result = search::Perft(board, depth-1);
-        board.UnMake();
-        std::cout << parse::MoveToString(move) << " depth: " << (depth-1)
-            << " perft: " << perft_result << std::endl;
-        sum += perft_result;
+      size_t num_threads = search::Threads.get_thread_count();
+      size_t hash_megabytes = perft::kPerftHashMB;
+      if (index < tokens.size()) {
+        num_threads = std::max(1, atoi(tokens[index++].c_str()));
       }
-      std::cout << "Ended perft" << std::endl;
-      Time end = now();
-      auto time_used = std::chrono::duration_cast<Milliseconds>(end-begin);
-      std::cout << "depth: " << depth << " perft: " << sum << " time: " << time_used.count()
-          << " nps: " << ((sum * 1000) / (time_used.count() + 1)) << std::endl;
+      if (index < tokens.size()) {
+        hash_megabytes = std::max(1, atoi(tokens[index++].c_str()));
+      }
+      perft::ParallelPerft(board, depth, num_threads, hash_megabytes, true);
+    }
+    else if (Equals(command, "ttstress")) {
+      size_t num_threads = 16;
+      size_t operations = 1000000;
+      if (index < tokens.size()) {
+        num_threads = std::max(1, atoi(tokens[index++].c_str()));
+      }
+      if (index < tokens.size()) {
+        operations = std::max(1, atoi(tokens[index++].c_str()));
+      }
+      std::cout << (table::StressTest(num_threads, operations) ? "ttstress passed" : "ttstress failed")
+                << std::endl;
     }
     else if (Equals(command, "perft_test")) {
       benchmark::PerftSuite();
@@ -402,9 +429,18 @@ void Loop() {
       }
       std::cout << std::endl;
     }
+    else if (Equals(command, "savehash") && index < tokens.size()) {
+      StopSearch();
+      table::SaveTable(tokens[index++]);
+    }
+    else if (Equals(command, "loadhash") && index < tokens.size()) {
+      StopSearch();
+      if (table::LoadTable(tokens[index++])) {
+        std::cout << "info string Hash " << table::GetTableDescription() << std::endl;
+      }
+    }
     else if (Equals(command, "can_repeat")) {
-      std::vector<Move> moves = board.GetMoves<kNonQuiescent>();
-      if (board.MoveInListCanRepeat(moves)) {
+      if (board.HasUpcomingRepetition()) {
         std::cout << "yes" << std::endl;
       }
       else {